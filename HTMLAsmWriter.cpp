@@ -68,14 +68,29 @@
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/Compiler.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/EndianStream.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/Format.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/SaveAndRestore.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/WithColor.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/raw_sha1_ostream.h"
+#include "llvm/Support/xxhash.h"
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cctype>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <iterator>
@@ -86,9 +101,28 @@
 #include <tuple>
 #include <utility>
 #include <vector>
+#ifdef LLVM_ON_UNIX
+#include <sys/resource.h>
+#endif
 #include "HTMLWriter.h"
+#include "HTMLProbes.h"
 using namespace llvm;
 
+#ifdef LLVM_HTML_PROBES_ENABLED
+#define LLVM_HTML_DEFINE_PROBE_SEMAPHORE(Name)                                 \
+  volatile unsigned short LLVM_HTML_PROBE_SEMAPHORE(Name)                      \
+      __attribute__((section(".probes"))) = 0
+extern "C" {
+LLVM_HTML_DEFINE_PROBE_SEMAPHORE(module_load_start);
+LLVM_HTML_DEFINE_PROBE_SEMAPHORE(module_load_end);
+LLVM_HTML_DEFINE_PROBE_SEMAPHORE(function_render_start);
+LLVM_HTML_DEFINE_PROBE_SEMAPHORE(function_render_end);
+LLVM_HTML_DEFINE_PROBE_SEMAPHORE(metadata_start);
+LLVM_HTML_DEFINE_PROBE_SEMAPHORE(metadata_end);
+LLVM_HTML_DEFINE_PROBE_SEMAPHORE(output_flush);
+}
+#endif
+
 // Make virtual table appear in this compilation unit.
 AssemblyAnnotationWriter::~AssemblyAnnotationWriter() = default;
 
@@ -426,6 +460,33 @@ static void PrintLLVMName(raw_ostream &OS, const Value *V) {
                 isa<GlobalValue>(V) ? GlobalPrefix : LocalPrefix);
 }
 
+/// Open a link to the definition anchored at \p Prefix followed by \p Id.
+static void writeDefRefOpen(raw_ostream &OS, StringRef Prefix, unsigned Id) {
+  OS << "<a href=\"#" << Prefix << Id << "\">";
+}
+
+/// Open the anchor of a definition, which links to itself so that the
+/// definition can be highlighted. \p PageURL names the page the definition is
+/// on, if relative links do not resolve against it.
+static void writeDefOpen(raw_ostream &OS, StringRef Prefix, unsigned Id,
+                         StringRef PageURL = "") {
+  OS << "<a class=\"def\" id=\"" << Prefix << Id << "\" href=\"";
+  printHTMLEscaped(OS, PageURL);
+  OS << "#" << Prefix << Id << "\">";
+}
+
+void printHTMLEscaped(raw_ostream &OS, StringRef Text) {
+  for (char C : Text) {
+    switch (C) {
+    case '<': OS << "&lt;"; break;
+    case '>': OS << "&gt;"; break;
+    case '&': OS << "&amp;"; break;
+    case '"': OS << "&quot;"; break;
+    default:  OS << C; break;
+    }
+  }
+}
+
 static void PrintShuffleMask(raw_ostream &Out, Type *Ty, ArrayRef<int> Mask) {
   Out << ", <";
   if (isa<ScalableVectorType>(Ty))
@@ -474,9 +535,29 @@ public:
 
   void printStructBody(StructType *Ty, raw_ostream &OS);
 
+  /// Number types exactly as \p Other does without walking the module again,
+  /// so that this printer can render types on another thread.
+  void copyNumbering(TypePrinting &Other);
+
+  /// Write identified struct names as links to their definitions. This has to
+  /// be decided before the first type is printed.
+  void setLinkNames(bool Link) {
+    assert(TypeStrings.empty() && "Types were already rendered");
+    LinkNames = Link;
+  }
+
+  /// Return the anchor id of the definition of \p STy, or -1 if it has none.
+  int getTypeAnchor(StructType *STy);
+
+  /// Approximate bytes held by the type tables and rendered types.
+  size_t getMemorySize() const;
+
 private:
   void incorporateTypes();
 
+  /// Render \p Ty without consulting the type string cache.
+  void printUncached(Type *Ty, raw_ostream &OS);
+
   /// A module to process lazily when needed. Set to nullptr as soon as used.
   const Module *DeferredM;
 
@@ -486,6 +567,22 @@ private:
   DenseMap<StructType *, unsigned> Type2Number;
 
   std::vector<StructType *> NumberedTypes;
+
+  /// Position of each named type in NamedTypes. Named types are anchored after
+  /// the numbered ones.
+  DenseMap<StructType *, unsigned> NamedTypeIds;
+
+  bool LinkNames = false;
+
+  /// Rendered text of the compound types printed so far. Struct, array,
+  /// vector and function types tend to be printed over and over again, so
+  /// each one is rendered once and copied on later uses.
+  DenseMap<Type *, std::string> TypeStrings;
+
+  /// Number of bytes held in TypeStrings; once MaxCachedTypeBytes is reached
+  /// new types are printed without being remembered.
+  size_t CachedTypeBytes = 0;
+  static constexpr size_t MaxCachedTypeBytes = 16 * 1024 * 1024;
 };
 
 } // end anonymous namespace
@@ -495,6 +592,23 @@ TypeFinder &TypePrinting::getNamedTypes() {
   return NamedTypes;
 }
 
+void TypePrinting::copyNumbering(TypePrinting &Other) {
+  Other.incorporateTypes();
+  DeferredM = nullptr;
+  Type2Number = Other.Type2Number;
+  NamedTypeIds = Other.NamedTypeIds;
+  LinkNames = Other.LinkNames;
+}
+
+int TypePrinting::getTypeAnchor(StructType *STy) {
+  incorporateTypes();
+  auto I = Type2Number.find(STy);
+  if (I != Type2Number.end())
+    return I->second;
+  auto J = NamedTypeIds.find(STy);
+  return J == NamedTypeIds.end() ? -1 : Type2Number.size() + J->second;
+}
+
 std::vector<StructType *> &TypePrinting::getNumberedTypes() {
   incorporateTypes();
 
@@ -513,6 +627,14 @@ std::vector<StructType *> &TypePrinting::getNumberedTypes() {
   return NumberedTypes;
 }
 
+size_t TypePrinting::getMemorySize() const {
+  return NamedTypes.size() * sizeof(StructType *) +
+         Type2Number.getMemorySize() +
+         NumberedTypes.capacity() * sizeof(StructType *) +
+         NamedTypeIds.getMemorySize() + TypeStrings.getMemorySize() +
+         CachedTypeBytes;
+}
+
 bool TypePrinting::empty() {
   incorporateTypes();
   return NamedTypes.empty() && Type2Number.empty();
@@ -542,11 +664,36 @@ void TypePrinting::incorporateTypes() {
   }
 
   NamedTypes.erase(NextToUse, NamedTypes.end());
+
+  for (unsigned I = 0, E = NamedTypes.size(); I != E; ++I)
+    NamedTypeIds[NamedTypes[I]] = I;
 }
 
 /// Write the specified type to the specified raw_ostream, making use of type
 /// names or up references to shorten the type name where possible.
 void TypePrinting::print(Type *Ty, raw_ostream &OS) {
+  // The primitive and integer type IDs precede the derived ones; these are
+  // single tokens and cheaper to print than to look up.
+  if (Ty->getTypeID() <= Type::IntegerTyID || Ty->isPointerTy())
+    return printUncached(Ty, OS);
+
+  auto I = TypeStrings.find(Ty);
+  if (I != TypeStrings.end()) {
+    OS << I->second;
+    return;
+  }
+
+  std::string TypeString;
+  raw_string_ostream TypeOS(TypeString);
+  printUncached(Ty, TypeOS);
+  OS << TypeOS.str();
+  if (CachedTypeBytes + TypeString.size() > MaxCachedTypeBytes)
+    return;
+  CachedTypeBytes += TypeString.size();
+  TypeStrings.try_emplace(Ty, std::move(TypeString));
+}
+
+void TypePrinting::printUncached(Type *Ty, raw_ostream &OS) {
   switch (Ty->getTypeID()) {
   case Type::VoidTyID:      OS << "void"; return;
   case Type::HalfTyID:      OS << "half"; return;
@@ -585,15 +732,23 @@ void TypePrinting::print(Type *Ty, raw_ostream &OS) {
     if (STy->isLiteral())
       return printStructBody(STy, OS);
 
-    if (!STy->getName().empty())
-      return PrintLLVMName(OS, STy->getName(), LocalPrefix);
+    int Anchor = LinkNames ? getTypeAnchor(STy) : -1;
+    if (Anchor != -1)
+      writeDefRefOpen(OS, "ty", Anchor);
+
+    if (!STy->getName().empty()) {
+      PrintLLVMName(OS, STy->getName(), LocalPrefix);
+    } else {
+      incorporateTypes();
+      const auto I = Type2Number.find(STy);
+      if (I != Type2Number.end())
+        OS << '%' << I->second;
+      else // Not enumerated, print the hex address.
+        OS << "%\"type " << STy << '\"';
+    }
 
-    incorporateTypes();
-    const auto I = Type2Number.find(STy);
-    if (I != Type2Number.end())
-      OS << '%' << I->second;
-    else  // Not enumerated, print the hex address.
-      OS << "%\"type " << STy << '\"';
+    if (Anchor != -1)
+      OS << "</a>";
     return;
   }
   case Type::PointerTyID: {
@@ -672,6 +827,35 @@ AbstractSlotTrackerStorage::~AbstractSlotTrackerStorage() = default;
 
 namespace llvm {
 
+/// The function level slot numbering of one function, in compact form.
+struct FunctionSlotTable {
+  /// The unnamed arguments, basic blocks and instructions, indexed by slot.
+  std::vector<const Value *> Values;
+
+  /// The function attribute sets of the calls in the function, in order of
+  /// first appearance.
+  std::vector<AttributeSet> CallAttrs;
+
+  /// The metadata attached to or used directly by the function, in the order
+  /// processFunctionMetadata() would reach it. Nodes only reachable through
+  /// these are numbered when the list is replayed.
+  std::vector<const MDNode *> MetadataRoots;
+};
+
+/// Slot tables for all functions of a module, computed up front in parallel so
+/// that printing a function does not have to number it first.
+class PrecomputedSlotTables {
+public:
+  explicit PrecomputedSlotTables(const Module &M);
+
+  /// Return the table of \p F, or null if it was not precomputed.
+  const FunctionSlotTable *lookup(const Function *F) const;
+
+private:
+  DenseMap<const Function *, unsigned> TableIndex;
+  std::vector<std::pair<const Function *, FunctionSlotTable>> Tables;
+};
+
 //===----------------------------------------------------------------------===//
 // SlotTracker Class: Enumerate slot numbers for unnamed values
 //===----------------------------------------------------------------------===//
@@ -699,6 +883,13 @@ private:
   /// The summary index for which we are holding slot numbers.
   const ModuleSummaryIndex *TheIndex = nullptr;
 
+  /// Function slot tables computed ahead of time, if any.
+  const PrecomputedSlotTables *PrecomputedSlots = nullptr;
+
+  /// If set, only the module level metadata and attribute sets reached from
+  /// this function are numbered, see restrictToFunction().
+  const Function *OnlyFunction = nullptr;
+
   /// mMap - The slot map for the module level data.
   ValueMap mMap;
   unsigned mNext = 0;
@@ -780,6 +971,31 @@ public:
 
   const Function *getFunction() const { return TheFunction; }
 
+  /// Take function level numbering from \p Tables instead of walking each
+  /// function when it is incorporated.
+  void setPrecomputedSlotTables(const PrecomputedSlotTables *Tables) {
+    PrecomputedSlots = Tables;
+  }
+  const PrecomputedSlotTables *getPrecomputedSlotTables() const {
+    return PrecomputedSlots;
+  }
+
+  /// Number only what a page holding just \p F prints: the unnamed globals
+  /// still get their slots, but the named metadata, the metadata attached to
+  /// globals and the attribute sets of other globals are left out. Must be
+  /// called before the module is processed.
+  void restrictToFunction(const Function *F) { OnlyFunction = F; }
+
+  /// Compute the function level slot numbering of \p F into \p Table. This
+  /// only reads \p F, so it may run concurrently for different functions.
+  static void computeFunctionSlotTable(const Function &F,
+                                       FunctionSlotTable &Table);
+
+  /// Collect the metadata roots of \p F into \p Table. Like
+  /// computeFunctionSlotTable() this only reads \p F.
+  static void collectFunctionMetadata(const Function &F,
+                                      FunctionSlotTable &Table);
+
   /// After calling incorporateFunction, use this method to remove the
   /// most recently incorporated function from the SlotTracker. This
   /// will reset the state of the machine back to just the module contents.
@@ -801,6 +1017,12 @@ public:
   unsigned as_size() const { return asMap.size(); }
   bool as_empty() const    { return asMap.empty(); }
 
+  /// Bytes allocated by the slot maps, for memory reports.
+  size_t getModuleMapBytes() const { return mMap.getMemorySize(); }
+  size_t getFunctionMapBytes() const { return fMap.getMemorySize(); }
+  size_t getMetadataMapBytes() const { return mdnMap.getMemorySize(); }
+  size_t getAttributeMapBytes() const { return asMap.getMemorySize(); }
+
   /// GUID map iterators.
   using guid_iterator = DenseMap<GlobalValue::GUID, unsigned>::iterator;
 
@@ -977,6 +1199,8 @@ void SlotTracker::processModule() {
   for (const GlobalVariable &Var : TheModule->globals()) {
     if (!Var.hasName())
       CreateModuleSlot(&Var);
+    if (OnlyFunction)
+      continue;
     processGlobalObjectMetadata(Var);
     auto Attrs = Var.getAttributes();
     if (Attrs.hasAttributes())
@@ -994,16 +1218,20 @@ void SlotTracker::processModule() {
   }
 
   // Add metadata used by named metadata.
-  for (const NamedMDNode &NMD : TheModule->named_metadata()) {
-    for (unsigned i = 0, e = NMD.getNumOperands(); i != e; ++i)
-      CreateMetadataSlot(NMD.getOperand(i));
-  }
+  if (!OnlyFunction)
+    for (const NamedMDNode &NMD : TheModule->named_metadata()) {
+      for (unsigned i = 0, e = NMD.getNumOperands(); i != e; ++i)
+        CreateMetadataSlot(NMD.getOperand(i));
+    }
 
   for (const Function &F : *TheModule) {
     if (!F.hasName())
       // Add all the unnamed functions to the table.
       CreateModuleSlot(&F);
 
+    if (OnlyFunction && &F != OnlyFunction)
+      continue;
+
     if (ShouldInitializeAllMetadata)
       processFunctionMetadata(F);
 
@@ -1029,40 +1257,116 @@ void SlotTracker::processFunction() {
   if (!ShouldInitializeAllMetadata)
     processFunctionMetadata(*TheFunction);
 
-  // Add all the function arguments with no names.
-  for(Function::const_arg_iterator AI = TheFunction->arg_begin(),
-      AE = TheFunction->arg_end(); AI != AE; ++AI)
-    if (!AI->hasName())
-      CreateFunctionSlot(&*AI);
+  // Use the precomputed numbering if there is one, otherwise number the
+  // function now.
+  FunctionSlotTable LocalTable;
+  const FunctionSlotTable *Table =
+      PrecomputedSlots ? PrecomputedSlots->lookup(TheFunction) : nullptr;
+  if (!Table) {
+    computeFunctionSlotTable(*TheFunction, LocalTable);
+    Table = &LocalTable;
+  }
 
   ST_DEBUG("Inserting Instructions:\n");
 
+  fMap.reserve(Table->Values.size());
+  for (const Value *V : Table->Values)
+    CreateFunctionSlot(V);
+
+  // Add all the call attributes to the table.
+  for (AttributeSet Attrs : Table->CallAttrs)
+    CreateAttributeSetSlot(Attrs);
+
+  if (ProcessFunctionHookFn)
+    ProcessFunctionHookFn(this, TheFunction, ShouldInitializeAllMetadata);
+
+  FunctionProcessed = true;
+
+  ST_DEBUG("end processFunction!\n");
+}
+
+void SlotTracker::computeFunctionSlotTable(const Function &F,
+                                           FunctionSlotTable &Table) {
+  // Add all the function arguments with no names.
+  for (const Argument &A : F.args())
+    if (!A.hasName())
+      Table.Values.push_back(&A);
+
   // Add all of the basic blocks and instructions with no names.
-  for (auto &BB : *TheFunction) {
+  for (auto &BB : F) {
     if (!BB.hasName())
-      CreateFunctionSlot(&BB);
+      Table.Values.push_back(&BB);
 
     for (auto &I : BB) {
       if (!I.getType()->isVoidTy() && !I.hasName())
-        CreateFunctionSlot(&I);
+        Table.Values.push_back(&I);
 
       // We allow direct calls to any llvm.foo function here, because the
       // target may not be linked into the optimizer.
       if (const auto *Call = dyn_cast<CallBase>(&I)) {
-        // Add all the call attributes to the table.
         AttributeSet Attrs = Call->getAttributes().getFnAttrs();
-        if (Attrs.hasAttributes())
-          CreateAttributeSetSlot(Attrs);
+        if (Attrs.hasAttributes() &&
+            (Table.CallAttrs.empty() || Table.CallAttrs.back() != Attrs))
+          Table.CallAttrs.push_back(Attrs);
       }
     }
   }
+}
 
-  if (ProcessFunctionHookFn)
-    ProcessFunctionHookFn(this, TheFunction, ShouldInitializeAllMetadata);
+void SlotTracker::collectFunctionMetadata(const Function &F,
+                                          FunctionSlotTable &Table) {
+  // A node seen before in this function already has a slot by the time it is
+  // replayed again, so only its first use needs to be kept.
+  SmallPtrSet<const MDNode *, 32> Seen;
+  auto AddRoot = [&](const MDNode *N) {
+    if (Seen.insert(N).second)
+      Table.MetadataRoots.push_back(N);
+  };
 
-  FunctionProcessed = true;
+  SmallVector<std::pair<unsigned, MDNode *>, 4> MDs;
+  F.getAllMetadata(MDs);
+  for (auto &MD : MDs)
+    AddRoot(MD.second);
 
-  ST_DEBUG("end processFunction!\n");
+  for (auto &BB : F) {
+    for (auto &I : BB) {
+      // Metadata used directly by intrinsics.
+      if (const CallInst *CI = dyn_cast<CallInst>(&I))
+        if (Function *Callee = CI->getCalledFunction())
+          if (Callee->isIntrinsic())
+            for (auto &Op : I.operands())
+              if (auto *V = dyn_cast_or_null<MetadataAsValue>(Op))
+                if (MDNode *N = dyn_cast<MDNode>(V->getMetadata()))
+                  AddRoot(N);
+
+      MDs.clear();
+      I.getAllMetadata(MDs);
+      for (auto &MD : MDs)
+        AddRoot(MD.second);
+    }
+  }
+}
+
+PrecomputedSlotTables::PrecomputedSlotTables(const Module &M) {
+  for (const Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    TableIndex[&F] = Tables.size();
+    Tables.emplace_back(&F, FunctionSlotTable());
+  }
+
+  // Numbering a function only reads it, so the functions are processed
+  // concurrently, each into its own preallocated table.
+  parallelForEach(Tables, [](std::pair<const Function *, FunctionSlotTable> &E) {
+    SlotTracker::computeFunctionSlotTable(*E.first, E.second);
+    SlotTracker::collectFunctionMetadata(*E.first, E.second);
+  });
+}
+
+const FunctionSlotTable *
+PrecomputedSlotTables::lookup(const Function *F) const {
+  auto I = TableIndex.find(F);
+  return I == TableIndex.end() ? nullptr : &Tables[I->second].second;
 }
 
 // Iterate through all the GUID in the index and create slots for them.
@@ -1107,6 +1411,15 @@ void SlotTracker::processGlobalObjectMetadata(const GlobalObject &GO) {
 }
 
 void SlotTracker::processFunctionMetadata(const Function &F) {
+  // The roots were discovered up front; numbering them here, in the same
+  // order, gives the same slots as the walk below.
+  if (const FunctionSlotTable *Table =
+          PrecomputedSlots ? PrecomputedSlots->lookup(&F) : nullptr) {
+    for (const MDNode *N : Table->MetadataRoots)
+      CreateMetadataSlot(N);
+    return;
+  }
+
   processGlobalObjectMetadata(F);
   for (auto &BB : F) {
     for (auto &I : BB)
@@ -1301,11 +1614,40 @@ void SlotTracker::CreateTypeIdSlot(StringRef Id) {
 }
 
 namespace {
+/// A bounded cache of slot tables for functions other than the one being
+/// printed. Such values are reached through blockaddress constants, and
+/// numbering the whole function again for every reference makes jump tables
+/// of computed-goto interpreters quadratic.
+class ForeignSlotCache {
+public:
+  /// Return the slot number of \p V in its own function, or -1.
+  int getLocalSlot(const Value *V);
+
+  /// Build slot tables from \p Tables rather than by walking the function.
+  void setPrecomputedSlotTables(const PrecomputedSlotTables *Tables) {
+    PrecomputedSlots = Tables;
+  }
+
+private:
+  static constexpr unsigned MaxFunctions = 64;
+
+  const PrecomputedSlotTables *PrecomputedSlots = nullptr;
+
+  /// The cached slot tables, least recently used first.
+  SmallVector<std::pair<const Function *, std::unique_ptr<SlotTracker>>, 8>
+      Entries;
+};
+
 /// Common instances used by most of the printer functions.
 struct AsmWriterContext {
   TypePrinting *TypePrinter = nullptr;
   SlotTracker *Machine = nullptr;
   const Module *Context = nullptr;
+  /// Slot tables for values of other functions, if the caller keeps them.
+  ForeignSlotCache *ForeignSlots = nullptr;
+  /// If set, metadata references are written as links to the definitions in
+  /// the page at this URL; an empty URL refers to the current page.
+  const std::string *MetadataURL = nullptr;
 
   AsmWriterContext(TypePrinting *TP, SlotTracker *ST, const Module *M = nullptr)
       : TypePrinter(TP), Machine(ST), Context(M) {}
@@ -1323,6 +1665,61 @@ struct AsmWriterContext {
 };
 } // end anonymous namespace
 
+int ForeignSlotCache::getLocalSlot(const Value *V) {
+  const Function *F = nullptr;
+  if (const auto *A = dyn_cast<Argument>(V))
+    F = A->getParent();
+  else if (const auto *I = dyn_cast<Instruction>(V))
+    F = I->getFunction();
+  else if (const auto *BB = dyn_cast<BasicBlock>(V))
+    F = BB->getParent();
+  if (!F)
+    return -1;
+
+  auto It = llvm::find_if(Entries, [F](const auto &E) { return E.first == F; });
+  if (It == Entries.end()) {
+    if (Entries.size() == MaxFunctions)
+      Entries.erase(Entries.begin());
+    // Local slots do not depend on the module level numbering, so only the
+    // function itself is processed.
+    auto Machine =
+        std::make_unique<SlotTracker>(static_cast<const Module *>(nullptr));
+    Machine->setPrecomputedSlotTables(PrecomputedSlots);
+    Machine->incorporateFunction(F);
+    Entries.emplace_back(F, std::move(Machine));
+  } else {
+    std::rotate(It, std::next(It), Entries.end());
+  }
+  return Entries.back().second->getLocalSlot(V);
+}
+
+/// Look up the slot of \p V, a function local value that is not in the slot
+/// table of the function being printed.
+static int getForeignLocalSlot(const Value *V, AsmWriterContext &WriterCtx) {
+  if (WriterCtx.ForeignSlots)
+    return WriterCtx.ForeignSlots->getLocalSlot(V);
+
+  int Slot = -1;
+  if (SlotTracker *Machine = createSlotTracker(V)) {
+    Slot = Machine->getLocalSlot(V);
+    delete Machine;
+  }
+  return Slot;
+}
+
+/// Write a reference to metadata slot \p Slot, as a link to its definition if
+/// the context asks for it.
+static void writeMetadataSlotRef(raw_ostream &Out, int Slot,
+                                 AsmWriterContext &WriterCtx) {
+  if (!WriterCtx.MetadataURL) {
+    Out << '!' << Slot;
+    return;
+  }
+  Out << "<a href=\"";
+  printHTMLEscaped(Out, *WriterCtx.MetadataURL);
+  Out << "#md" << Slot << "\">!" << Slot << "</a>";
+}
+
 //===----------------------------------------------------------------------===//
 // AsmWriter Implementation
 //===----------------------------------------------------------------------===//
@@ -1353,6 +1750,208 @@ static void WriteOptimizationInfo(raw_ostream &Out, const User *U) {
   }
 }
 
+static void WriteAPFloatInternal(raw_ostream &Out, const APFloat &APF) {
+  if (&APF.getSemantics() == &APFloat::IEEEsingle() ||
+      &APF.getSemantics() == &APFloat::IEEEdouble()) {
+    // We would like to output the FP constant value in exponential notation,
+    // but we cannot do this if doing so will lose precision.  Check here to
+    // make sure that we only output it in exponential format if we can parse
+    // the value back and get the same value.
+    //
+    bool ignored;
+    bool isDouble = &APF.getSemantics() == &APFloat::IEEEdouble();
+    bool isInf = APF.isInfinity();
+    bool isNaN = APF.isNaN();
+    if (!isInf && !isNaN) {
+      double Val = APF.convertToDouble();
+      SmallString<128> StrVal;
+      APF.toString(StrVal, 6, 0, false);
+      // Check to make sure that the stringized number is not some string like
+      // "Inf" or NaN, that atof will accept, but the lexer will not.  Check
+      // that the string matches the "[-+]?[0-9]" regex.
+      //
+      assert((isDigit(StrVal[0]) || ((StrVal[0] == '-' || StrVal[0] == '+') &&
+                                     isDigit(StrVal[1]))) &&
+             "[-+]?[0-9] regex does not match!");
+      // Reparse stringized version!
+      if (APFloat(APFloat::IEEEdouble(), StrVal).convertToDouble() == Val) {
+        Out << StrVal;
+        return;
+      }
+    }
+    // Otherwise we could not reparse it to exactly the same value, so we must
+    // output the string in hexadecimal format!  Note that loading and storing
+    // floating point types changes the bits of NaNs on some hosts, notably
+    // x86, so we must not use these types.
+    static_assert(sizeof(double) == sizeof(uint64_t),
+                  "assuming that double is 64 bits!");
+    APFloat apf = APF;
+    // Floats are represented in ASCII IR as double, convert.
+    // FIXME: We should allow 32-bit hex float and remove this.
+    if (!isDouble) {
+      // A signaling NaN is quieted on conversion, so we need to recreate the
+      // expected value after convert (quiet bit of the payload is clear).
+      bool IsSNAN = apf.isSignaling();
+      apf.convert(APFloat::IEEEdouble(), APFloat::rmNearestTiesToEven,
+                  &ignored);
+      if (IsSNAN) {
+        APInt Payload = apf.bitcastToAPInt();
+        apf = APFloat::getSNaN(APFloat::IEEEdouble(), apf.isNegative(),
+                               &Payload);
+      }
+    }
+    Out << format_hex(apf.bitcastToAPInt().getZExtValue(), 0, /*Upper=*/true);
+    return;
+  }
+
+  // Either half, bfloat or some form of long double.
+  // These appear as a magic letter identifying the type, then a
+  // fixed number of hex digits.
+  Out << "0x";
+  APInt API = APF.bitcastToAPInt();
+  if (&APF.getSemantics() == &APFloat::x87DoubleExtended()) {
+    Out << 'K';
+    Out << format_hex_no_prefix(API.getHiBits(16).getZExtValue(), 4,
+                                /*Upper=*/true);
+    Out << format_hex_no_prefix(API.getLoBits(64).getZExtValue(), 16,
+                                /*Upper=*/true);
+    return;
+  } else if (&APF.getSemantics() == &APFloat::IEEEquad()) {
+    Out << 'L';
+    Out << format_hex_no_prefix(API.getLoBits(64).getZExtValue(), 16,
+                                /*Upper=*/true);
+    Out << format_hex_no_prefix(API.getHiBits(64).getZExtValue(), 16,
+                                /*Upper=*/true);
+  } else if (&APF.getSemantics() == &APFloat::PPCDoubleDouble()) {
+    Out << 'M';
+    Out << format_hex_no_prefix(API.getLoBits(64).getZExtValue(), 16,
+                                /*Upper=*/true);
+    Out << format_hex_no_prefix(API.getHiBits(64).getZExtValue(), 16,
+                                /*Upper=*/true);
+  } else if (&APF.getSemantics() == &APFloat::IEEEhalf()) {
+    Out << 'H';
+    Out << format_hex_no_prefix(API.getZExtValue(), 4,
+                                /*Upper=*/true);
+  } else if (&APF.getSemantics() == &APFloat::BFloat()) {
+    Out << 'R';
+    Out << format_hex_no_prefix(API.getZExtValue(), 4,
+                                /*Upper=*/true);
+  } else
+    llvm_unreachable("Unsupported floating point type");
+}
+
+/// Characters printEscapedString passes through unchanged.
+static const std::array<bool, 256> &getPlainStringChars() {
+  static const std::array<bool, 256> Plain = [] {
+    std::array<bool, 256> Table{};
+    for (unsigned C = 0x20; C <= 0x7E; ++C)
+      Table[C] = C != '\\' && C != '"';
+    return Table;
+  }();
+  return Plain;
+}
+
+/// WriteEscapedStringFast - Equivalent to printEscapedString, but copies runs
+/// of characters that need no escaping with a single write instead of
+/// classifying and writing one character at a time.
+static void WriteEscapedStringFast(raw_ostream &Out, StringRef Str) {
+  const std::array<bool, 256> &Plain = getPlainStringChars();
+  const char *Cur = Str.begin(), *End = Str.end();
+  while (Cur != End) {
+    const char *RunStart = Cur;
+    while (Cur != End && Plain[static_cast<unsigned char>(*Cur)])
+      ++Cur;
+    if (Cur != RunStart)
+      Out.write(RunStart, Cur - RunStart);
+    if (Cur == End)
+      break;
+
+    unsigned char C = *Cur++;
+    if (C == '\\') {
+      Out << "\\\\";
+      continue;
+    }
+    char Escape[3] = {'\\', hexdigit(C >> 4), hexdigit(C & 0x0F)};
+    Out.write(Escape, sizeof(Escape));
+  }
+}
+
+/// WriteDecimalFast - Append \p Value in decimal to \p Buffer. Digits are
+/// produced two at a time from a lookup table.
+static void WriteDecimalFast(SmallVectorImpl<char> &Buffer, int64_t Value) {
+  static const char DigitPairs[] =
+      "00010203040506070809101112131415161718192021222324"
+      "25262728293031323334353637383940414243444546474849"
+      "50515253545556575859606162636465666768697071727374"
+      "75767778798081828384858687888990919293949596979899";
+
+  char Digits[20];
+  char *End = Digits + sizeof(Digits);
+  char *P = End;
+  uint64_t Magnitude =
+      Value < 0 ? 0 - static_cast<uint64_t>(Value) : static_cast<uint64_t>(Value);
+  while (Magnitude >= 100) {
+    unsigned Pair = (Magnitude % 100) * 2;
+    Magnitude /= 100;
+    *--P = DigitPairs[Pair + 1];
+    *--P = DigitPairs[Pair];
+  }
+  if (Magnitude >= 10) {
+    unsigned Pair = Magnitude * 2;
+    *--P = DigitPairs[Pair + 1];
+    *--P = DigitPairs[Pair];
+  } else {
+    *--P = '0' + Magnitude;
+  }
+  if (Value < 0)
+    Buffer.push_back('-');
+  Buffer.append(P, End);
+}
+
+/// WriteConstantDataSequentialFast - Print the elements of \p CDS straight
+/// from its raw data buffer, without materializing a Constant per element.
+/// This covers every element type a ConstantDataSequential can have (i8, i16,
+/// i32, i64, half, bfloat, float and double), so printing one never creates
+/// constants, which the parallel metadata writer relies on.
+static void WriteConstantDataSequentialFast(raw_ostream &Out,
+                                            const ConstantDataSequential *CDS,
+                                            AsmWriterContext &WriterCtx) {
+  Type *ETy = CDS->getElementType();
+  bool IsInteger = ETy->isIntegerTy();
+  assert((IsInteger || ETy->isFloatingPointTy()) &&
+         "Unexpected ConstantDataSequential element type");
+
+  // The element type is the same for every element; render it once.
+  SmallString<16> Prefix;
+  raw_svector_ostream PrefixOS(Prefix);
+  WriterCtx.TypePrinter->print(ETy, PrefixOS);
+  Prefix.push_back(' ');
+
+  // Format into a local buffer and hand it to the stream in large chunks.
+  const size_t FlushThreshold = 64 * 1024;
+  SmallString<256> Buffer;
+  raw_svector_ostream BufferOS(Buffer);
+  unsigned BitWidth = IsInteger ? ETy->getIntegerBitWidth() : 0;
+
+  Buffer.push_back(isa<ConstantDataArray>(CDS) ? '[' : '<');
+  for (unsigned I = 0, E = CDS->getNumElements(); I != E; ++I) {
+    if (I)
+      Buffer.append({',', ' '});
+    Buffer.append(Prefix.begin(), Prefix.end());
+    if (IsInteger)
+      WriteDecimalFast(Buffer,
+                       SignExtend64(CDS->getElementAsInteger(I), BitWidth));
+    else
+      WriteAPFloatInternal(BufferOS, CDS->getElementAsAPFloat(I));
+    if (Buffer.size() >= FlushThreshold) {
+      Out << Buffer;
+      Buffer.clear();
+    }
+  }
+  Buffer.push_back(isa<ConstantDataArray>(CDS) ? ']' : '>');
+  Out << Buffer;
+}
+
 static void WriteConstantInternal(raw_ostream &Out, const Constant *CV,
                                   AsmWriterContext &WriterCtx) {
   if (const ConstantInt *CI = dyn_cast<ConstantInt>(CV)) {
@@ -1365,94 +1964,7 @@ static void WriteConstantInternal(raw_ostream &Out, const Constant *CV,
   }
 
   if (const ConstantFP *CFP = dyn_cast<ConstantFP>(CV)) {
-    const APFloat &APF = CFP->getValueAPF();
-    if (&APF.getSemantics() == &APFloat::IEEEsingle() ||
-        &APF.getSemantics() == &APFloat::IEEEdouble()) {
-      // We would like to output the FP constant value in exponential notation,
-      // but we cannot do this if doing so will lose precision.  Check here to
-      // make sure that we only output it in exponential format if we can parse
-      // the value back and get the same value.
-      //
-      bool ignored;
-      bool isDouble = &APF.getSemantics() == &APFloat::IEEEdouble();
-      bool isInf = APF.isInfinity();
-      bool isNaN = APF.isNaN();
-      if (!isInf && !isNaN) {
-        double Val = APF.convertToDouble();
-        SmallString<128> StrVal;
-        APF.toString(StrVal, 6, 0, false);
-        // Check to make sure that the stringized number is not some string like
-        // "Inf" or NaN, that atof will accept, but the lexer will not.  Check
-        // that the string matches the "[-+]?[0-9]" regex.
-        //
-        assert((isDigit(StrVal[0]) || ((StrVal[0] == '-' || StrVal[0] == '+') &&
-                                       isDigit(StrVal[1]))) &&
-               "[-+]?[0-9] regex does not match!");
-        // Reparse stringized version!
-        if (APFloat(APFloat::IEEEdouble(), StrVal).convertToDouble() == Val) {
-          Out << StrVal;
-          return;
-        }
-      }
-      // Otherwise we could not reparse it to exactly the same value, so we must
-      // output the string in hexadecimal format!  Note that loading and storing
-      // floating point types changes the bits of NaNs on some hosts, notably
-      // x86, so we must not use these types.
-      static_assert(sizeof(double) == sizeof(uint64_t),
-                    "assuming that double is 64 bits!");
-      APFloat apf = APF;
-      // Floats are represented in ASCII IR as double, convert.
-      // FIXME: We should allow 32-bit hex float and remove this.
-      if (!isDouble) {
-        // A signaling NaN is quieted on conversion, so we need to recreate the
-        // expected value after convert (quiet bit of the payload is clear).
-        bool IsSNAN = apf.isSignaling();
-        apf.convert(APFloat::IEEEdouble(), APFloat::rmNearestTiesToEven,
-                    &ignored);
-        if (IsSNAN) {
-          APInt Payload = apf.bitcastToAPInt();
-          apf = APFloat::getSNaN(APFloat::IEEEdouble(), apf.isNegative(),
-                                 &Payload);
-        }
-      }
-      Out << format_hex(apf.bitcastToAPInt().getZExtValue(), 0, /*Upper=*/true);
-      return;
-    }
-
-    // Either half, bfloat or some form of long double.
-    // These appear as a magic letter identifying the type, then a
-    // fixed number of hex digits.
-    Out << "0x";
-    APInt API = APF.bitcastToAPInt();
-    if (&APF.getSemantics() == &APFloat::x87DoubleExtended()) {
-      Out << 'K';
-      Out << format_hex_no_prefix(API.getHiBits(16).getZExtValue(), 4,
-                                  /*Upper=*/true);
-      Out << format_hex_no_prefix(API.getLoBits(64).getZExtValue(), 16,
-                                  /*Upper=*/true);
-      return;
-    } else if (&APF.getSemantics() == &APFloat::IEEEquad()) {
-      Out << 'L';
-      Out << format_hex_no_prefix(API.getLoBits(64).getZExtValue(), 16,
-                                  /*Upper=*/true);
-      Out << format_hex_no_prefix(API.getHiBits(64).getZExtValue(), 16,
-                                  /*Upper=*/true);
-    } else if (&APF.getSemantics() == &APFloat::PPCDoubleDouble()) {
-      Out << 'M';
-      Out << format_hex_no_prefix(API.getLoBits(64).getZExtValue(), 16,
-                                  /*Upper=*/true);
-      Out << format_hex_no_prefix(API.getHiBits(64).getZExtValue(), 16,
-                                  /*Upper=*/true);
-    } else if (&APF.getSemantics() == &APFloat::IEEEhalf()) {
-      Out << 'H';
-      Out << format_hex_no_prefix(API.getZExtValue(), 4,
-                                  /*Upper=*/true);
-    } else if (&APF.getSemantics() == &APFloat::BFloat()) {
-      Out << 'R';
-      Out << format_hex_no_prefix(API.getZExtValue(), 4,
-                                  /*Upper=*/true);
-    } else
-      llvm_unreachable("Unsupported floating point type");
+    WriteAPFloatInternal(Out, CFP->getValueAPF());
     return;
   }
 
@@ -1503,23 +2015,12 @@ static void WriteConstantInternal(raw_ostream &Out, const Constant *CV,
     // i8 with ConstantInt values.
     if (CA->isString()) {
       Out << "c\"";
-      printEscapedString(CA->getAsString(), Out);
+      WriteEscapedStringFast(Out, CA->getAsString());
       Out << '"';
       return;
     }
 
-    Type *ETy = CA->getType()->getElementType();
-    Out << '[';
-    WriterCtx.TypePrinter->print(ETy, Out);
-    Out << ' ';
-    WriteAsOperandInternal(Out, CA->getElementAsConstant(0), WriterCtx);
-    for (unsigned i = 1, e = CA->getNumElements(); i != e; ++i) {
-      Out << ", ";
-      WriterCtx.TypePrinter->print(ETy, Out);
-      Out << ' ';
-      WriteAsOperandInternal(Out, CA->getElementAsConstant(i), WriterCtx);
-    }
-    Out << ']';
+    WriteConstantDataSequentialFast(Out, CA, WriterCtx);
     return;
   }
 
@@ -1551,7 +2052,12 @@ static void WriteConstantInternal(raw_ostream &Out, const Constant *CV,
     return;
   }
 
-  if (isa<ConstantVector>(CV) || isa<ConstantDataVector>(CV)) {
+  if (const auto *CDV = dyn_cast<ConstantDataVector>(CV)) {
+    WriteConstantDataSequentialFast(Out, CDV, WriterCtx);
+    return;
+  }
+
+  if (isa<ConstantVector>(CV)) {
     auto *CVVTy = cast<FixedVectorType>(CV->getType());
     Type *ETy = CVVTy->getElementType();
     Out << '<';
@@ -2415,6 +2921,204 @@ static void WriteMDNodeBodyInternal(raw_ostream &Out, const MDNode *Node,
 
 namespace {
 
+/// On-disk cache of rendered function bodies, see HTMLWriterOptions::CacheDir.
+/// The functions of a page are packed into one file per page, named with the
+/// "llvmcache-" prefix so that llvm::pruneCache can expire and bound them.
+/// The pack is a fixed header followed by one record per function: its key,
+/// its text, the style rules its links add and the (definition tag, link id)
+/// pairs of those links. A hit is copied out of the mapped pack as is.
+///
+/// The pack is written again after the page only if it changed, and then
+/// holds only the functions of this rendering, so entries of functions that
+/// changed or went away do not pile up.
+class FunctionRenderCache {
+  std::string Path;
+
+  static constexpr char Magic[8] = {'L', 'L', 'H', 'T', 'M', 'L', 'C', '2'};
+  static constexpr size_t RecordHeaderSize = 4 * sizeof(uint64_t);
+
+  struct Entry {
+    StringRef Text;
+    StringRef Styles;
+    /// Little endian pairs of 64-bit definition tags and link ids.
+    StringRef Uses;
+  };
+  /// The pack read from disk, and its entries by key.
+  std::unique_ptr<MemoryBuffer> Pack;
+  StringMap<Entry> Packed;
+  /// The entries of this rendering, which make up the next pack. Those that
+  /// were stored rather than found are copied into Saver.
+  StringMap<Entry> Used;
+  BumpPtrAllocator Alloc;
+  StringSaver Saver{Alloc};
+  unsigned NumStored = 0;
+
+  void read();
+
+public:
+  /// Open the pack of the page identified by \p PageKey in \p Dir.
+  FunctionRenderCache(StringRef Dir, StringRef PageKey) {
+    SmallString<128> P(Dir);
+    sys::path::append(P, "llvmcache-" + utohexstr(xxHash64(PageKey)));
+    Path = std::string(P);
+    read();
+  }
+
+  /// Look up the entry for \p Key. On a hit, \p Text and \p Styles point into
+  /// the pack, and so does \p Uses, as little endian pairs of 64-bit
+  /// definition tags and link ids.
+  bool lookup(StringRef Key, StringRef &Text, StringRef &Styles,
+              StringRef &Uses) {
+    auto I = Packed.find(Key);
+    if (I == Packed.end())
+      return false;
+    Used[Key] = I->second;
+    Text = I->second.Text;
+    Styles = I->second.Styles;
+    Uses = I->second.Uses;
+    return true;
+  }
+
+  /// Add an entry for \p Key to the next pack.
+  void store(StringRef Key, StringRef Text, StringRef Styles,
+             ArrayRef<std::pair<uint64_t, uint64_t>> Uses) {
+    std::string UseBytes;
+    raw_string_ostream OS(UseBytes);
+    support::endian::Writer W(OS, support::little);
+    for (const auto &Use : Uses) {
+      W.write<uint64_t>(Use.first);
+      W.write<uint64_t>(Use.second);
+    }
+    Used[Key] = {Saver.save(Text), Saver.save(Styles), Saver.save(OS.str())};
+    ++NumStored;
+  }
+
+  /// Write the pack of this rendering. It is written to a temporary file and
+  /// renamed into place, so that concurrent writers and readers only ever see
+  /// complete packs. Failures only cost later misses and are ignored.
+  void save();
+};
+
+void FunctionRenderCache::read() {
+  auto BufOrErr = MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                        /*RequiresNullTerminator=*/false);
+  if (!BufOrErr)
+    return;
+  Pack = std::move(*BufOrErr);
+  StringRef Data = Pack->getBuffer();
+  if (Data.size() < sizeof(Magic) + sizeof(uint64_t) ||
+      !Data.startswith(StringRef(Magic, sizeof(Magic))))
+    return;
+  uint64_t NumEntries =
+      support::endian::read64le(Data.data() + sizeof(Magic));
+  Data = Data.drop_front(sizeof(Magic) + sizeof(uint64_t));
+
+  // A truncated or foreign pack is a miss for every function; it gets
+  // rewritten.
+  StringMap<Entry> Entries;
+  for (uint64_t I = 0; I != NumEntries; ++I) {
+    if (Data.size() < RecordHeaderSize)
+      return;
+    uint64_t Sizes[4];
+    for (unsigned J = 0; J != 4; ++J)
+      Sizes[J] = support::endian::read64le(Data.data() + J * 8);
+    Data = Data.drop_front(RecordHeaderSize);
+    StringRef Parts[4];
+    for (unsigned J = 0; J != 4; ++J) {
+      if (Data.size() < Sizes[J])
+        return;
+      Parts[J] = Data.take_front(Sizes[J]);
+      Data = Data.drop_front(Sizes[J]);
+    }
+    Entries[Parts[0]] = {Parts[1], Parts[2], Parts[3]};
+  }
+  Packed = std::move(Entries);
+}
+
+void FunctionRenderCache::save() {
+  if (!NumStored && Used.size() == Packed.size()) {
+    // Unchanged; only mark it as used, for the expiration of pruneCache.
+    sys::fs::setLastAccessAndModificationTime(Path,
+                                              sys::TimePoint<>::clock::now());
+    return;
+  }
+
+  int FD;
+  SmallString<128> TempPath;
+  if (sys::fs::createUniqueFile(Path + "-%%%%%%%%.tmp", FD, TempPath))
+    return;
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    support::endian::Writer W(OS, support::little);
+    OS.write(Magic, sizeof(Magic));
+    W.write<uint64_t>(Used.size());
+    // Written in key order, so that the pack does not depend on the order
+    // of the functions.
+    std::vector<StringRef> Keys;
+    for (const auto &E : Used)
+      Keys.push_back(E.getKey());
+    llvm::sort(Keys);
+    for (StringRef Key : Keys) {
+      const Entry &E = Used.find(Key)->second;
+      for (StringRef Part : {Key, E.Text, E.Styles, E.Uses})
+        W.write<uint64_t>(Part.size());
+      OS << Key << E.Text << E.Styles << E.Uses;
+    }
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      sys::fs::remove(TempPath);
+      return;
+    }
+  }
+  if (sys::fs::rename(TempPath, Path))
+    sys::fs::remove(TempPath);
+}
+
+constexpr char FunctionRenderCache::Magic[8];
+
+/// A stream passing its output on to a target that can be changed, so that
+/// the rendering of a single function can be captured from a page.
+class RedirectableStream : public raw_ostream {
+  raw_ostream *Target;
+  uint64_t Pos = 0;
+
+  void write_impl(const char *Ptr, size_t Size) override {
+    Target->write(Ptr, Size);
+    Pos += Size;
+  }
+  uint64_t current_pos() const override { return Pos; }
+
+public:
+  explicit RedirectableStream(raw_ostream &Target) : Target(&Target) {}
+
+  /// Send the output to \p NewTarget from now on. Returns the old target.
+  raw_ostream &redirect(raw_ostream &NewTarget) {
+    flush();
+    raw_ostream &OldTarget = *Target;
+    Target = &NewTarget;
+    return OldTarget;
+  }
+};
+
+/// One row of the function statistics page.
+struct FunctionStats {
+  const Function *F = nullptr;
+  unsigned Instructions = 0;
+  unsigned Blocks = 0;
+  unsigned Calls = 0;
+  unsigned Loads = 0;
+  unsigned Stores = 0;
+  unsigned Allocas = 0;
+  /// Instructions producing or taking a vector.
+  unsigned VectorInstructions = 0;
+  unsigned PHIs = 0;
+  unsigned MaxBlockSize = 0;
+  unsigned DebugIntrinsics = 0;
+  /// Bytes of HTML and styles the function rendered to.
+  uint64_t RenderedBytes = 0;
+};
+
 class HTMLAssemblyWriter {
   formatted_raw_ostream &Out;
   raw_ostream &CSSOut;
@@ -2426,34 +3130,129 @@ class HTMLAssemblyWriter {
   TypePrinting TypePrinter;
   AssemblyAnnotationWriter *AnnotationWriter = nullptr;
   SetVector<const Comdat *> Comdats;
+  /// Anchor id of each comdat, its position in Comdats.
+  DenseMap<const Comdat *, unsigned> ComdatIds;
   bool IsForDebug;
   bool ShouldPreserveUseListOrder;
+  HTMLWriterOptions Options;
+  /// Number of initializer sidecar files written so far.
+  unsigned NumInitializerSidecars = 0;
+  /// The page holding the metadata definitions, as seen from the page being
+  /// written; empty when they are on the same page.
+  std::string MetadataURL;
+  /// The separate metadata page while it is not written yet. It is opened up
+  /// front so that, if it cannot be, the metadata stays on the page, and it
+  /// is removed again if the module turns out to have no metadata for it.
+  std::unique_ptr<raw_fd_ostream> MetadataShard;
+  /// Relative URLs of the pages in Options.Symbols, computed on first use.
+  std::vector<std::string> SymbolPageURLs;
+  ForeignSlotCache ForeignSlots;
   UseListOrderMap UseListOrders;
   SmallVector<StringRef, 8> MDNames;
   /// Synchronization scope names registered with LLVMContext.
   SmallVector<StringRef, 8> SSNs;
-  DenseMap<const GlobalValueSummary *, GlobalValue::GUID> SummaryToGUIDMap;
   std::set<uint64_t> KnownHTMLTags;
   std::map<uint64_t, std::set<uint64_t> > DefToUseMap;
+  /// Tags of the values that get anchors, see collectAllHTMLFunctionTags.
+  DenseMap<const void *, uint64_t> HTMLTags;
+  /// The links printed so far are numbered from LinkIdBase. Each function
+  /// numbers its links from its own tag, so that they do not depend on what
+  /// was printed before it.
+  uint64_t LinkIdBase = 0;
+  uint64_t NumLinkIds = 0;
+  /// The render cache, and the stream under Out that is redirected to
+  /// capture a function for it.
+  std::unique_ptr<FunctionRenderCache> RenderCache;
+  RedirectableStream *PageStream = nullptr;
+  /// While a function is captured for the render cache, the style rules and
+  /// definition uses of its links are collected here instead of going to
+  /// CSSOut and DefToUseMap.
+  std::string *CapturedStyles = nullptr;
+  std::vector<std::pair<uint64_t, uint64_t>> *CapturedUses = nullptr;
+  /// Bytes that went through Out without being part of the page: functions
+  /// captured for the render cache, which went through Out once more when
+  /// copied to the page, and the folded parts written to sidecar pages.
+  uint64_t RecapturedBytes = 0;
+  /// The sidecar page being written for a folded construct, as seen from the
+  /// page; empty while writing the page itself.
+  std::string FoldedPageURL;
+  /// The sidecar pages holding the definitions of the instructions past the
+  /// MaxBlockInstructions budget of the function being printed, and the
+  /// index into FoldedDefinitionPages of the page of each, by tag.
+  std::vector<std::string> FoldedDefinitionPages;
+  DenseMap<uint64_t, unsigned> FoldedDefinitionPageOf;
+  /// The function statistics page as seen from the page, if it is written,
+  /// and its rows, one per defined function in module order.
+  std::string StatsPageURL;
+  std::vector<FunctionStats> FunctionStatsRows;
+
+  /// The ways an AttributeSet gets rendered: as written on a parameter (or in
+  /// an attribute group), as a return attribute list, and as the
+  /// "; Function Attrs:" comment.
+  enum AttributeSetStringKind {
+    ASK_Plain,
+    ASK_InAttrGroup,
+    ASK_Return,
+    ASK_FnComment,
+    ASK_NumKinds
+  };
+
+  /// Rendered attribute sets. Most functions and call sites share a handful
+  /// of sets, so each distinct set is rendered once per kind and reused.
+  DenseMap<AttributeSet, std::string> AttributeSetStrings[ASK_NumKinds];
 
 public:
   /// Construct an HTMLAssemblyWriter with an external SlotTracker
   HTMLAssemblyWriter(formatted_raw_ostream &o, formatted_raw_ostream &cssos,
                      std::string cssfilename, SlotTracker &Mac, const Module *M,
                      AssemblyAnnotationWriter *AAW, bool IsForDebug,
-                     bool ShouldPreserveUseListOrder = false);
+                     bool ShouldPreserveUseListOrder = false,
+                     const HTMLWriterOptions &Options = HTMLWriterOptions());
 
   HTMLAssemblyWriter(formatted_raw_ostream &o, formatted_raw_ostream &csso,
                      std::string cssfilename, SlotTracker &Mac,
                      const ModuleSummaryIndex *Index, bool IsForDebug);
 
+  ~HTMLAssemblyWriter();
+
   AsmWriterContext getContext() {
-    return AsmWriterContext(&TypePrinter, &Machine, TheModule);
-  }
+    AsmWriterContext WriterCtx(&TypePrinter, &Machine, TheModule);
+    WriterCtx.ForeignSlots = &ForeignSlots;
+    // An outline prints no metadata for references to link to.
+    if (!Options.Outline)
+      WriterCtx.MetadataURL = &MetadataURL;
+    return WriterCtx;
+  }
+
+  /// Set \p PageStream as the stream underlying Out, through which
+  /// functions are captured for the render cache and folded constructs are
+  /// written to their sidecar pages.
+  void setPageStream(RedirectableStream &PageStream) {
+    this->PageStream = &PageStream;
+  }
+  /// Render functions through the cache in Options.CacheDir. Requires a page
+  /// stream.
+  void enableRenderCache();
+  /// Write what the render cache learned from this page, if enabled.
+  void saveRenderCache();
 
   std::string getHTMLLinkId(uint64_t Tag);
   std::string getHTMLId(uint64_t tag);
   uint64_t getHTMLTag(const void *P);
+  uint64_t takeHTMLLinkId() { return LinkIdBase + NumLinkIds++; }
+  /// Return the timer of a phase, or null if phases are not timed.
+  Timer *getPhaseTimer(Timer HTMLWriterTimers::*Phase) {
+    return Options.Timers ? &(Options.Timers->*Phase) : nullptr;
+  }
+  /// Add a sample of the memory held so far to Options.MemorySamples, if
+  /// set.
+  void sampleMemory(StringRef Phase);
+  /// Return the number of bytes of the page written so far.
+  uint64_t getPageOffset() { return Out.tell() - RecapturedBytes; }
+  /// Start and finish a section of Options.Sections, if set.
+  void beginSection(StringRef Function);
+  void endSection();
+  void printHTMLLinkStyles(const std::string &LinkId, const std::string &URL);
   void printHTMLMainStyles();
   void printHTMLTagsStyles();
   void printHTMLStart(const std::string Title);
@@ -2468,7 +3267,8 @@ public:
   void printHTMLOperand(std::string Text, uint64_t Tag);
   void printHTMLLLVMName(raw_ostream &OS, const Value *V, bool IsDef = false);
   void printHTMLLLVMName(raw_ostream &OS, StringRef Name, PrefixType Prefix, uint64_t Tag, bool IsDef = false);
-  void collectAllHTMLFunctionTags(const Module *M);
+  void collectAllHTMLFunctionTags(const Module *M,
+                                  const Function *Body = nullptr);
   void collectAllHTMLBodyTags(const Function *F);
   std::string getModuleDocURL() {
     return "https://llvm.org/docs/LangRef.html#module-structure";
@@ -2481,6 +3281,10 @@ public:
     return "https://llvm.org/docs/LangRef.html#linkage-types";
   }
 
+  std::string getSummaryDocURL() {
+    return "https://llvm.org/docs/LangRef.html#thinlto-summary";
+  }
+
   std::string getVisibilityTypesDocURL() {
     return "https://llvm.org/docs/LangRef.html#visibility-styles";
   }
@@ -2503,27 +3307,106 @@ public:
                           AtomicOrdering FailureOrdering,
                           SyncScope::ID SSID);
 
-  void writeAllMDNodes();
-  void writeMDNode(unsigned Slot, const MDNode *Node);
-  void writeAttribute(const Attribute &Attr, bool InAttrGroup = false);
+  std::string getMetadataShardPath() const {
+    return Options.OutputPath + ".metadata.html";
+  }
+  void openMetadataShard();
+  void collectFunctionStats(const Module *M);
+  void writeFunctionStatsPage(StringRef Title);
+  void writeMetadataShard(StringRef Title);
+  void writeAllMDNodes(raw_ostream &OS);
+  void writeMDNodesParallel(raw_ostream &OS, ArrayRef<const MDNode *> Nodes);
+  void writeMDNode(raw_ostream &OS, unsigned Slot, const MDNode *Node);
+  void writeAttribute(raw_ostream &OS, const Attribute &Attr,
+                      bool InAttrGroup = false);
   void writeAttributeSet(const AttributeSet &AttrSet, bool InAttrGroup = false);
+  const std::string &getAttributeSetString(AttributeSet AS,
+                                           AttributeSetStringKind Kind);
   void writeAllAttributeGroups();
+  void writeAttributeGroupRef(AttributeSet AS);
 
   void printTypeIdentities();
   void printGlobal(const GlobalVariable *GV);
+  bool shouldElideInitializer(const GlobalVariable *GV);
+  std::optional<uint64_t> printElidedInitializer(const GlobalVariable *GV);
+  std::string writeInitializerSidecar(StringRef Body);
+  /// Report \p Path, a file written next to the page, in Options.Sidecars.
+  void addSidecar(StringRef Path) {
+    if (Options.Sidecars)
+      Options.Sidecars->push_back(std::string(Path));
+  }
+  std::string getPageURL() {
+    return std::string(sys::path::filename(Options.OutputPath));
+  }
+  bool canWriteFoldedPages() {
+    return !Options.OutputPath.empty() && PageStream;
+  }
+  std::string getFoldedPageURL(const Twine &Name) {
+    return (getPageURL() + "." + Name + ".html").str();
+  }
+  void printFolded(const Twine &Name, const Twine &Summary,
+                   function_ref<void()> PrintRest);
+  void collectFoldedDefinitions(const Function *F);
+  bool hasFoldedConstructs(const Function *F);
   void printAlias(const GlobalAlias *GA);
   void printIFunc(const GlobalIFunc *GI);
   void printComdat(const Comdat *C);
+  std::string getExternalDefinitionURL(const GlobalValue *GV);
+  void printExternalDefinitionLink(const GlobalValue *GV);
+  void printGlobalAnchor(const GlobalValue *GV);
+  int getComdatId(const Comdat *C) {
+    auto I = ComdatIds.find(C);
+    return I == ComdatIds.end() ? -1 : (int)I->second;
+  }
   void printFunction(const Function *F);
+  void printFunctionPage(const Function *F);
+  void printOutlineSummary(const Function *F);
+  uint64_t measureRenderedSize(const Function *F);
+  void printCachedFunction(const Function *F);
+  std::string getFunctionCacheKey(const Function *F);
+  void hashOperand(raw_ostream &Hash, const Value *V);
+  void hashMetadataAttachments(
+      raw_ostream &Hash,
+      const SmallVectorImpl<std::pair<unsigned, MDNode *>> &MDs);
+  void hashInstruction(raw_ostream &Hash, const Instruction &I);
   void printArgument(const Argument *FA, AttributeSet Attrs);
   void printBasicBlock(const BasicBlock *BB);
   void printInstructionLine(const Instruction &I);
   void printInstruction(const Instruction &I);
+  void printOperandList(const Instruction &I, bool PrintAllTypes = false);
+  void printReturnInst(const ReturnInst &RI);
+  void printBranchInst(const BranchInst &BI);
+  void printSwitchInst(const SwitchInst &SI);
+  void printIndirectBrInst(const IndirectBrInst &IBI);
+  void printInvokeInst(const InvokeInst &II);
+  void printCallBrInst(const CallBrInst &CBI);
+  void printCallInst(const CallInst &CI);
+  void printCatchSwitchInst(const CatchSwitchInst &CSI);
+  void printFuncletPadInst(const FuncletPadInst &FPI);
+  void printCatchReturnInst(const CatchReturnInst &CRI);
+  void printCleanupReturnInst(const CleanupReturnInst &CRI);
+  void printPHINode(const PHINode &PN);
+  void printLandingPadInst(const LandingPadInst &LPI);
+  void printExtractValueInst(const ExtractValueInst &EVI);
+  void printInsertValueInst(const InsertValueInst &IVI);
+  void printAllocaInst(const AllocaInst &AI);
+  void printLoadInst(const LoadInst &LI);
+  void printStoreInst(const StoreInst &SI);
+  void printFenceInst(const FenceInst &FI);
+  void printAtomicCmpXchgInst(const AtomicCmpXchgInst &CXI);
+  void printAtomicRMWInst(const AtomicRMWInst &RMWI);
+  void printCmpInst(const CmpInst &CI);
+  void printVAArgInst(const VAArgInst &VAI);
+  void printShuffleVectorInst(const ShuffleVectorInst &SVI);
+  void printGetElementPtrInst(const GetElementPtrInst &GEP);
+  void printCastInst(const CastInst &CI);
 
   void printUseListOrder(const Value *V, const std::vector<unsigned> &Shuffle);
   void printUseLists(const Function *F);
 
   void printModuleSummaryIndex();
+  void writeSummarySlotDef(int Slot);
+  void writeSummarySlotRef(int Slot);
   void printSummaryInfo(unsigned Slot, const ValueInfo &VI);
   void printSummary(const GlobalValueSummary &Summary);
   void printAliasSummary(const AliasSummary *AS);
@@ -2577,10 +3460,18 @@ void HTMLAssemblyWriter::WriteAsOperandInternal2(raw_ostream &Out,
     std::string NameString;
     raw_string_ostream NameOS(NameString);
     PrintLLVMName(NameOS, V);
-    if (IsDef)
+    if (IsDef) {
       printHTMLTag(NameOS.str(), getHTMLTag(V));
-    else
-      printHTMLOperand(NameOS.str(), V);
+      return;
+    }
+    if (const auto *GV = dyn_cast<GlobalValue>(V)) {
+      std::string URL = getExternalDefinitionURL(GV);
+      if (!URL.empty()) {
+        printHTMLLink(NameOS.str(), URL);
+        return;
+      }
+    }
+    printHTMLOperand(NameOS.str(), V);
     return;
   }
 
@@ -2631,10 +3522,7 @@ void HTMLAssemblyWriter::WriteAsOperandInternal2(raw_ostream &Out,
       // from a different function.  Translate it, as this can happen when using
       // address of blocks.
       if (Slot == -1)
-        if ((Machine = createSlotTracker(V))) {
-          Slot = Machine->getLocalSlot(V);
-          delete Machine;
-        }
+        Slot = getForeignLocalSlot(V, WriterCtx);
     }
   } else if ((Machine = createSlotTracker(V))) {
     // Otherwise, create one to get the # and then destroy it.
@@ -2688,7 +3576,7 @@ void HTMLAssemblyWriter::WriteAsOperandInternal2(raw_ostream &Out,
       // the time when debugging.
       Out << "<" << N << ">";
     } else
-      Out << '!' << Slot;
+      writeMetadataSlotRef(Out, Slot, WriterCtx);
     return;
   }
 
@@ -2766,10 +3654,7 @@ static void WriteAsOperandInternal(raw_ostream &Out,
       // from a different function.  Translate it, as this can happen when using
       // address of blocks.
       if (Slot == -1)
-        if ((Machine = createSlotTracker(V))) {
-          Slot = Machine->getLocalSlot(V);
-          delete Machine;
-        }
+        Slot = getForeignLocalSlot(V, WriterCtx);
     }
   } else if ((Machine = createSlotTracker(V))) {
     // Otherwise, create one to get the # and then destroy it.
@@ -2822,7 +3707,7 @@ static void WriteAsOperandInternal(raw_ostream &Out, const Metadata *MD,
       // the time when debugging.
       Out << "<" << N << ">";
     } else
-      Out << '!' << Slot;
+      writeMetadataSlotRef(Out, Slot, WriterCtx);
     return;
   }
 
@@ -2849,15 +3734,52 @@ HTMLAssemblyWriter::HTMLAssemblyWriter(formatted_raw_ostream &o,
                                        SlotTracker &Mac, const Module *M,
                                        AssemblyAnnotationWriter *AAW,
                                        bool IsForDebug,
-                                       bool ShouldPreserveUseListOrder)
+                                       bool ShouldPreserveUseListOrder,
+                                       const HTMLWriterOptions &Options)
     : Out(o), CSSOut(csso), CSSFileName(cssfilename), TheModule(M), Machine(Mac), TypePrinter(M), AnnotationWriter(AAW),
       IsForDebug(IsForDebug),
-      ShouldPreserveUseListOrder(ShouldPreserveUseListOrder) {
+      ShouldPreserveUseListOrder(ShouldPreserveUseListOrder),
+      Options(Options) {
+  ForeignSlots.setPrecomputedSlotTables(Mac.getPrecomputedSlotTables());
   if (!TheModule)
     return;
   for (const GlobalObject &GO : TheModule->global_objects())
     if (const Comdat *C = GO.getComdat())
-      Comdats.insert(C);
+      if (Comdats.insert(C))
+        ComdatIds[C] = Comdats.size() - 1;
+  TypePrinter.setLinkNames(true);
+  if (Options.ShardMetadata && !Options.Outline)
+    openMetadataShard();
+}
+
+/// Open the metadata page, so that metadata references link there. If it
+/// cannot be opened, they link within the page, where the metadata is then
+/// printed.
+void HTMLAssemblyWriter::openMetadataShard() {
+  if (Options.OutputPath.empty()) {
+    WithColor::warning() << "metadata is only sharded when writing to a file\n";
+    return;
+  }
+
+  std::string Path = getMetadataShardPath();
+  std::error_code EC;
+  auto OS = std::make_unique<raw_fd_ostream>(Path, EC, sys::fs::OF_Text);
+  if (EC) {
+    WithColor::warning() << Path << ": " << EC.message()
+                         << "; metadata is kept on the page\n";
+    return;
+  }
+  MetadataShard = std::move(OS);
+  MetadataURL = std::string(sys::path::filename(Path));
+}
+
+HTMLAssemblyWriter::~HTMLAssemblyWriter() {
+  // Nothing was written to the metadata page; do not leave it behind empty.
+  if (MetadataShard) {
+    MetadataShard->close();
+    MetadataShard->clear_error();
+    sys::fs::remove(getMetadataShardPath());
+  }
 }
 
 HTMLAssemblyWriter::HTMLAssemblyWriter(formatted_raw_ostream &o,
@@ -2983,15 +3905,26 @@ void HTMLAssemblyWriter::writeOperandBundles(const CallBase *Call) {
   Out << " ]";
 }
 
+/// The style rules that are the same on every page.
+static void writeMainStyles(raw_ostream &OS) {
+  OS << "a:link {\n";
+  OS << "  color:black;\n";
+  OS << "  text-decoration:none;\n";
+  OS << "}\n";
+  OS << "a:visited {\n";
+  OS << "  color:black;\n";
+  OS << "  text-decoration:none;\n";
+  OS << "}\n";
+  OS << ".def:target {\n";
+  OS << "  background-color: #ffa;\n";
+  OS << "}\n";
+}
+
 void HTMLAssemblyWriter::printHTMLMainStyles() {
-  CSSOut << "a:link {\n";
-  CSSOut << "  color:black;\n";
-  CSSOut << "  text-decoration:none;\n";
-  CSSOut << "}\n";
-  CSSOut << "a:visited {\n";
-  CSSOut << "  color:black;\n";
-  CSSOut << "  text-decoration:none;\n";
-  CSSOut << "}\n";
+  // A page sharing a stylesheet links to these rules instead.
+  if (!Options.StyleSheetURL.empty())
+    return;
+  writeMainStyles(CSSOut);
 }
 void HTMLAssemblyWriter::printHTMLTagsStyles() {
   for (auto Tag : KnownHTMLTags) {
@@ -3009,6 +3942,9 @@ void HTMLAssemblyWriter::printHTMLStart(const std::string Title) {
   printHTMLMainStyles();
   printHTMLTagsStyles();
   Out << "<link rel=\"stylesheet\" href=\"" << CSSFileName << "\">\n";
+  if (!Options.StyleSheetURL.empty())
+    Out << "<link rel=\"stylesheet\" href=\"" << Options.StyleSheetURL
+        << "\">\n";
   Out << "<title>";
   Out << Title;
   Out << "</title>\n";
@@ -3050,7 +3986,11 @@ void HTMLAssemblyWriter::printCSSDefLinks() {
 }
 
 void HTMLAssemblyWriter::printHTMLEnd() {
-  printCSSDefLinks();
+  {
+    TimeRegion T(getPhaseTimer(&HTMLWriterTimers::PrintCSSDefLinks));
+    TimeTraceScope TT("PrintCSSDefLinks");
+    printCSSDefLinks();
+  }
   Out << "</pre>\n";
   Out << "</body>\n";
   Out << "</html>\n";
@@ -3069,21 +4009,38 @@ std::string HTMLAssemblyWriter::getHTMLLinkId(uint64_t Tag) {
 }
 
 uint64_t HTMLAssemblyWriter::getHTMLTag(const void *P) {
-  return (uint64_t)P;
+  auto I = HTMLTags.find(P);
+  return I == HTMLTags.end() ? (uint64_t)P : I->second;
+}
+
+/// Write the rules highlighting the target of link \p LinkId while it is
+/// hovered, and the link while its target is.
+static void writeLinkStyles(raw_ostream &OS, const std::string &LinkId,
+                            const std::string &URL) {
+  OS << "#" << LinkId << ":hover ~ " << URL << " {";
+  OS << " background-color: #ffa; }\n";
+  OS << URL << ":has(~ #" << LinkId << ":hover) {";
+  OS << " background-color: #ffa; }\n";
+}
+
+void HTMLAssemblyWriter::printHTMLLinkStyles(const std::string &LinkId,
+                                             const std::string &URL) {
+  if (!CapturedStyles) {
+    writeLinkStyles(CSSOut, LinkId, URL);
+    return;
+  }
+  raw_string_ostream OS(*CapturedStyles);
+  writeLinkStyles(OS, LinkId, URL);
 }
 
 void HTMLAssemblyWriter::printHTMLLink(const std::string Text,
                                        const std::string URL) {
-  static uint64_t count = 0;
   //  Out << "<a href=\"" << URL << "\" style=\"text-decoration:none\" target=\"_blank\">" << Text << "</a>";
   //  Out << "<a href=\"" << URL << "\" >" << Text << "</a>";
   if(URL.rfind("#", 0) == 0) {
-    Out << "<a id=\"" << getHTMLLinkId(count) << "\" href=\"" << URL << "\" >" << Text << "</a>";
-    CSSOut << "#" << getHTMLLinkId(count) << ":hover ~ " << URL << " {";
-    CSSOut << " background-color: #ffa; }\n";
-    CSSOut << URL << ":has(~ #" << getHTMLLinkId(count) << ":hover) {";
-    CSSOut << " background-color: #ffa; }\n";
-    count ++;
+    std::string LinkId = getHTMLLinkId(takeHTMLLinkId());
+    Out << "<a id=\"" << LinkId << "\" href=\"" << URL << "\" >" << Text << "</a>";
+    printHTMLLinkStyles(LinkId, URL);
   } else {
     Out << "<a href=\"" << URL << "\" style=\"text-decoration:none\" >" << Text << "</a>";
   }
@@ -3094,29 +4051,38 @@ void HTMLAssemblyWriter::printHTMLTagLink(const std::string Text,
   std::string URL;
   URL+="#";
   URL+=getHTMLId(Tag);
-  static uint64_t count = 0;
+  // Links from or to the folded parts of a page name the page they go to,
+  // and go without the hover styles, which only work within a page.
+  if (!FoldedPageURL.empty() || !FoldedDefinitionPageOf.empty()) {
+    auto I = FoldedDefinitionPageOf.find(Tag);
+    if (I != FoldedDefinitionPageOf.end())
+      URL = FoldedDefinitionPages[I->second] + URL;
+    else if (!FoldedPageURL.empty())
+      URL = getPageURL() + URL;
+  }
   //  Out << "<a href=\"" << URL << "\" style=\"text-decoration:none\" target=\"_blank\">" << Text << "</a>";
   //  Out << "<a href=\"" << URL << "\" >" << Text << "</a>";
   if(URL.rfind("#", 0) == 0) {
-    Out << "<a id=\"" << getHTMLLinkId(count) << "\" href=\"" << URL << "\" style=\"text-decoration:none\" >" << Text << "</a>";
-    CSSOut << "#" << getHTMLLinkId(count) << ":hover ~ " << URL << " {";
-    CSSOut << " background-color: #ffa; }\n";
-    CSSOut << URL << ":has(~ #" << getHTMLLinkId(count) << ":hover) {";
-    CSSOut << " background-color: #ffa; }\n";
-    DefToUseMap[Tag].insert(count);
-    count ++;
+    uint64_t Link = takeHTMLLinkId();
+    std::string LinkId = getHTMLLinkId(Link);
+    Out << "<a id=\"" << LinkId << "\" href=\"" << URL << "\" style=\"text-decoration:none\" >" << Text << "</a>";
+    printHTMLLinkStyles(LinkId, URL);
+    if (CapturedUses)
+      CapturedUses->emplace_back(Tag, Link);
+    else
+      DefToUseMap[Tag].insert(Link);
   } else {
     Out << "<a href=\"" << URL << "\" style=\"text-decoration:none\" >" << Text << "</a>";
   }
 }
 
 void HTMLAssemblyWriter::printHTMLTag(std::string Text, const void* Tag) {
-  printHTMLTag(Text, (uint64_t)(Tag));
+  printHTMLTag(Text, getHTMLTag(Tag));
 }
 
 void HTMLAssemblyWriter::printHTMLTag(std::string Text, uint64_t Tag) {
-  Out << "<a tag id=\"" << getHTMLId(Tag) << "\" href=\"#" << getHTMLId(Tag)
-      << "\">" << Text << "</a>";
+  Out << "<a tag id=\"" << getHTMLId(Tag) << "\" href=\"" << FoldedPageURL
+      << "#" << getHTMLId(Tag) << "\">" << Text << "</a>";
 }
 
 void HTMLAssemblyWriter::printHTMLOperand(std::string Text, const Value *V) {
@@ -3164,39 +4130,73 @@ void HTMLAssemblyWriter::printHTMLLLVMName(raw_ostream &OS, StringRef Name, Pref
     printHTMLOperand(NameOS.str(), Tag);
 }
 
-void HTMLAssemblyWriter::collectAllHTMLFunctionTags(const Module *M) {
+/// If \p Body is set, only the body of that function is collected, and only
+/// that function of the globals gets an anchor: the others are not on its
+/// page, so references to them are printed without a link.
+/// Tags derive from names rather than addresses, so that the markup of a
+/// function is the same from one run to the next: a global's tag hashes its
+/// name (or its slot, if it has none) and the values of a function body are
+/// numbered from the tag of the function.
+void HTMLAssemblyWriter::collectAllHTMLFunctionTags(const Module *M,
+                                                    const Function *Body) {
+  unsigned NumUnnamed = 0;
+  auto AddGlobalTag = [&](const GlobalValue &GV) {
+    uint64_t Tag = GV.hasName()
+                       ? xxHash64(GV.getName())
+                       : xxHash64("@" + std::to_string(NumUnnamed++));
+    HTMLTags[&GV] = Tag;
+    if (!Body || &GV == Body)
+      KnownHTMLTags.insert(Tag);
+  };
+  // Unnamed globals are visited in slot order.
+  for (const GlobalVariable &GV : M->globals())
+    AddGlobalTag(GV);
   for (const Function &F : *M) {
-    uint64_t Tag = getHTMLTag(&F);
-    KnownHTMLTags.insert(Tag);
-    collectAllHTMLBodyTags(&F);
-  }
-  for (auto GI = M->global_begin(); GI != M->global_end(); ++GI) {
-    KnownHTMLTags.insert(getHTMLTag(&(*GI)));
+    AddGlobalTag(F);
+    if (!Body || &F == Body)
+      collectAllHTMLBodyTags(&F);
   }
 }
 
 void HTMLAssemblyWriter::collectAllHTMLBodyTags(const Function *F) {
+  uint64_t Tag = getHTMLTag(F);
+  auto AddTag = [&](const void *P) {
+    HTMLTags[P] = ++Tag;
+    KnownHTMLTags.insert(Tag);
+  };
+
   // Collect Function Arg Tags
-  for (auto &Arg : F->args()) {
-    auto ArgTag = getHTMLTag(&Arg);
-    KnownHTMLTags.insert(ArgTag);
-  }
+  for (auto &Arg : F->args())
+    AddTag(&Arg);
 
   // Collect Function Body Tags
   for (const BasicBlock &BB : *F) {
-    auto BBTag = getHTMLTag(&BB);
-    KnownHTMLTags.insert(BBTag);
-    for (const Instruction &I : BB) {
-      auto InstTag = getHTMLTag(&I);
-      KnownHTMLTags.insert(InstTag);
-    }
+    AddTag(&BB);
+    for (const Instruction &I : BB)
+      AddTag(&I);
   }
 }
 
 void HTMLAssemblyWriter::printModule(const Module *M) {
-  collectAllHTMLFunctionTags(M);
-
-  Machine.initializeIfNeeded();
+  {
+    TimeRegion T(getPhaseTimer(&HTMLWriterTimers::CollectTags));
+    TimeTraceScope TT("CollectTags");
+    collectAllHTMLFunctionTags(M);
+  }
+  sampleMemory("collect-tags");
+  {
+    TimeRegion T(getPhaseTimer(&HTMLWriterTimers::NumberSlots));
+    TimeTraceScope TT("NumberSlots");
+    Machine.initializeIfNeeded();
+  }
+  sampleMemory("number-slots");
+  if (Options.FunctionStatsPage)
+    collectFunctionStats(M);
+
+  // Everything up to the def-use styles of printHTMLEnd is the body.
+  Timer *BodyTimer = getPhaseTimer(&HTMLWriterTimers::PrintBody);
+  if (BodyTimer)
+    BodyTimer->startTimer();
 
   if (ShouldPreserveUseListOrder)
     UseListOrders = predictUseListOrder(M);
@@ -3223,6 +4223,12 @@ void HTMLAssemblyWriter::printModule(const Module *M) {
   if (!M->getTargetTriple().empty())
     Out << "target triple = \"" << M->getTargetTriple() << "\"\n";
 
+  if (!StatsPageURL.empty()) {
+    Out << "; function statistics in ";
+    printHTMLLink(StatsPageURL, StatsPageURL);
+    Out << '\n';
+  }
+
   if (!M->getModuleInlineAsm().empty()) {
     Out << '\n';
 
@@ -3268,10 +4274,52 @@ void HTMLAssemblyWriter::printModule(const Module *M) {
     printIFunc(&GI);
 
   // Output all of the functions.
+  unsigned NumStatsRows = 0;
+  bool TimeTrace = timeTraceProfilerEnabled();
   for (const Function &F : *M) {
     Out << '\n';
-    printFunction(&F);
-  }
+    if (F.isDeclaration()) {
+      printCachedFunction(&F);
+      continue;
+    }
+    uint64_t PageBegin = getPageOffset(), StylesBegin = CSSOut.tell();
+    // Counting the instructions takes a pass over the body, so it is only
+    // done for the trace, the function times and attached probes.
+    bool NeedsSize = TimeTrace || Options.FunctionTimes ||
+                     LLVM_HTML_PROBE_ACTIVE(function_render_start) ||
+                     LLVM_HTML_PROBE_ACTIVE(function_render_end);
+    unsigned NumInstructions = NeedsSize ? F.getInstructionCount() : 0;
+    TimeTraceScope TT("PrintFunction", [&] {
+      return (F.getName() + " (" + Twine(NumInstructions) + " instructions)")
+          .str();
+    });
+    std::chrono::steady_clock::time_point Start;
+    if (Options.FunctionTimes)
+      Start = std::chrono::steady_clock::now();
+    LLVM_HTML_PROBE3(function_render_start, F.getName().data(),
+                     F.getName().size(), NumInstructions);
+    beginSection(F.getName());
+    printCachedFunction(&F);
+    endSection();
+    LLVM_HTML_PROBE3(function_render_end, F.getName().data(),
+                     F.getName().size(), NumInstructions);
+    // Rows are only collected for the bodies that are loaded.
+    if (!StatsPageURL.empty() && !F.isMaterializable())
+      FunctionStatsRows[NumStatsRows++].RenderedBytes =
+          getPageOffset() - PageBegin + CSSOut.tell() - StylesBegin;
+    if (Options.FunctionTimes)
+      Options.FunctionTimes->push_back(
+          {std::string(F.getName()), NumInstructions,
+           std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         Start)
+               .count()});
+  }
+
+  sampleMemory("functions");
+  if (!StatsPageURL.empty())
+    writeFunctionStatsPage(M->getModuleIdentifier().empty()
+                               ? StringRef("Module")
+                               : StringRef(M->getModuleIdentifier()));
 
   // Output global use-lists.
   printUseLists(nullptr);
@@ -3282,25 +4330,304 @@ void HTMLAssemblyWriter::printModule(const Module *M) {
     writeAllAttributeGroups();
   }
 
+  // An outline leaves out the metadata.
+  if (Options.Outline && !Machine.mdn_empty())
+    Out << "\n; " << Machine.mdn_size() << " metadata nodes not shown\n";
+
   // Output named metadata.
-  if (!M->named_metadata_empty()) Out << '\n';
+  if (!M->named_metadata_empty() && !Options.Outline) Out << '\n';
+
+  if (!Options.Outline)
+    for (const NamedMDNode &Node : M->named_metadata())
+      printNamedMDNode(&Node);
+
+  // Output metadata, either here or on its own page that is only loaded once
+  // one of its links is followed.
+  if (!Machine.mdn_empty() && !Options.Outline) {
+    TimeTraceScope TT("PrintMetadata");
+    LLVM_HTML_PROBE1(metadata_start, Machine.mdn_size());
+    beginSection("");
+    Out << '\n';
+    if (MetadataShard) {
+      Out << "; " << Machine.mdn_size() << " metadata nodes in ";
+      std::string EscapedURL;
+      raw_string_ostream EscapedOS(EscapedURL);
+      printHTMLEscaped(EscapedOS, MetadataURL);
+      printHTMLLink(EscapedOS.str(), EscapedOS.str());
+      Out << '\n';
+      writeMetadataShard(M->getModuleIdentifier().empty()
+                             ? StringRef("Module")
+                             : StringRef(M->getModuleIdentifier()));
+    } else {
+      writeAllMDNodes(Out);
+    }
+    endSection();
+    LLVM_HTML_PROBE1(metadata_end, Machine.mdn_size());
+  }
+  if (BodyTimer)
+    BodyTimer->stopTimer();
+  sampleMemory("metadata");
+  printHTMLEnd();
+  sampleMemory("css-def-links");
+}
+
+void HTMLAssemblyWriter::beginSection(StringRef Function) {
+  if (!Options.Sections)
+    return;
+  HTMLPageSection Section;
+  Section.Function = std::string(Function);
+  Section.PageBegin = getPageOffset();
+  Section.StylesBegin = CSSOut.tell();
+  Options.Sections->push_back(std::move(Section));
+}
+
+void HTMLAssemblyWriter::endSection() {
+  if (!Options.Sections)
+    return;
+  Options.Sections->back().PageEnd = getPageOffset();
+  Options.Sections->back().StylesEnd = CSSOut.tell();
+}
 
-  for (const NamedMDNode &Node : M->named_metadata())
-    printNamedMDNode(&Node);
+/// Approximate bytes of a node of a std::set or std::map holding
+/// \p ValueBytes.
+static constexpr size_t treeNodeBytes(size_t ValueBytes) {
+  return 4 * sizeof(void *) + ValueBytes;
+}
+
+void HTMLAssemblyWriter::sampleMemory(StringRef Phase) {
+  if (!Options.MemorySamples)
+    return;
+  if (!Options.IRBytes && TheModule)
+    Options.IRBytes = HTMLMemorySample::getApproximateIRSize(*TheModule);
+  HTMLMemorySample S = HTMLMemorySample::take(Phase, Options.IRBytes);
+  S.Tags = KnownHTMLTags.size() * treeNodeBytes(sizeof(uint64_t)) +
+           HTMLTags.getMemorySize();
+  for (const auto &DefUses : DefToUseMap)
+    S.DefToUse += treeNodeBytes(sizeof(DefUses)) +
+                  DefUses.second.size() * treeNodeBytes(sizeof(uint64_t));
+  S.ModuleSlots = Machine.getModuleMapBytes();
+  S.FunctionSlots = Machine.getFunctionMapBytes();
+  S.MetadataSlots = Machine.getMetadataMapBytes();
+  S.AttributeSlots = Machine.getAttributeMapBytes();
+  S.Types = TypePrinter.getMemorySize();
+  S.Output = Out.tell() + CSSOut.tell();
+  Options.MemorySamples->push_back(std::move(S));
+}
+
+/// Approximate bytes held by \p M: its globals, instructions and operands,
+/// and the metadata they refer to. Constants are not counted.
+uint64_t HTMLMemorySample::getApproximateIRSize(const Module &M) {
+  uint64_t Size = sizeof(Module);
+  SmallPtrSet<const Metadata *, 32> Visited;
+  SmallVector<const Metadata *, 32> Worklist;
+  auto VisitMetadata = [&](const Metadata *MD) {
+    if (MD && Visited.insert(MD).second)
+      Worklist.push_back(MD);
+  };
+  SmallVector<std::pair<unsigned, MDNode *>, 4> MDs;
+  auto VisitAttachments = [&](const auto &Object) {
+    MDs.clear();
+    Object.getAllMetadata(MDs);
+    for (auto &MD : MDs)
+      VisitMetadata(MD.second);
+  };
+
+  for (const GlobalVariable &GV : M.globals()) {
+    Size += sizeof(GlobalVariable) + GV.getName().size();
+    VisitAttachments(GV);
+  }
+  for (const Function &F : M) {
+    Size += sizeof(Function) + F.getName().size() +
+            F.arg_size() * sizeof(Argument);
+    VisitAttachments(F);
+    for (const BasicBlock &BB : F) {
+      Size += sizeof(BasicBlock) + BB.getName().size();
+      for (const Instruction &I : BB) {
+        Size += sizeof(Instruction) + I.getNumOperands() * sizeof(Use) +
+                I.getName().size();
+        VisitAttachments(I);
+        for (const Value *Op : I.operand_values())
+          if (const auto *MAV = dyn_cast<MetadataAsValue>(Op))
+            VisitMetadata(MAV->getMetadata());
+      }
+    }
+  }
+  for (const NamedMDNode &NMD : M.named_metadata())
+    for (const MDNode *N : NMD.operands())
+      VisitMetadata(N);
+
+  while (!Worklist.empty()) {
+    const Metadata *MD = Worklist.pop_back_val();
+    if (const auto *N = dyn_cast<MDNode>(MD)) {
+      Size += sizeof(MDNode) + N->getNumOperands() * sizeof(MDOperand);
+      for (const MDOperand &Op : N->operands())
+        VisitMetadata(Op.get());
+    } else if (const auto *S = dyn_cast<MDString>(MD)) {
+      Size += sizeof(MDString) + S->getLength();
+    } else if (const auto *AL = dyn_cast<DIArgList>(MD)) {
+      Size += sizeof(DIArgList) + AL->getArgs().size() * sizeof(void *);
+    } else {
+      Size += sizeof(ValueAsMetadata);
+    }
+  }
+  return Size;
+}
+
+HTMLMemorySample HTMLMemorySample::take(StringRef Phase, uint64_t IR) {
+  HTMLMemorySample S;
+  S.Phase = std::string(Phase);
+  S.IR = IR;
+#ifdef LLVM_ON_UNIX
+  struct rusage Usage;
+  if (getrusage(RUSAGE_SELF, &Usage) == 0) {
+#ifdef __APPLE__
+    S.PeakRSS = Usage.ru_maxrss;
+#else
+    S.PeakRSS = uint64_t(Usage.ru_maxrss) * 1024;
+#endif
+  }
+#endif
+  return S;
+}
+
+/// printFunctionPage - Print a page holding only \p F, with the types,
+/// attribute groups and metadata its body refers to. The slot tracker should
+/// be restricted to \p F, or the page also gets the module's other metadata
+/// and attribute groups.
+void HTMLAssemblyWriter::printFunctionPage(const Function *F) {
+  collectAllHTMLFunctionTags(TheModule, F);
+
+  Machine.initializeIfNeeded();
+
+  printHTMLStart(std::string(F->getName()));
+  printTypeIdentities();
+  Out << '\n';
+  {
+    TimeTraceScope TT("PrintFunction", F->getName());
+    bool Traced = LLVM_HTML_PROBE_ACTIVE(function_render_start) ||
+                  LLVM_HTML_PROBE_ACTIVE(function_render_end);
+    unsigned NumInstructions = Traced ? F->getInstructionCount() : 0;
+    LLVM_HTML_PROBE3(function_render_start, F->getName().data(),
+                     F->getName().size(), NumInstructions);
+    printFunction(F);
+    LLVM_HTML_PROBE3(function_render_end, F->getName().data(),
+                     F->getName().size(), NumInstructions);
+  }
+
+  if (!Machine.as_empty()) {
+    Out << '\n';
+    writeAllAttributeGroups();
+  }
 
-  // Output metadata.
   if (!Machine.mdn_empty()) {
+    TimeTraceScope TT("PrintMetadata");
+    LLVM_HTML_PROBE1(metadata_start, Machine.mdn_size());
     Out << '\n';
-    writeAllMDNodes();
+    writeAllMDNodes(Out);
+    LLVM_HTML_PROBE1(metadata_end, Machine.mdn_size());
   }
   printHTMLEnd();
 }
 
+/// printOutlineSummary - Print the size of the body of \p F in its place: its
+/// blocks, instructions and calls and the bytes of its rendering if it is
+/// loaded, or else what the module summary knows of it.
+void HTMLAssemblyWriter::printOutlineSummary(const Function *F) {
+  if (F->isMaterializable()) {
+    const FunctionSummary *FS = nullptr;
+    if (Options.OutlineSummary)
+      if (ValueInfo VI = Options.OutlineSummary->getValueInfo(F->getGUID()))
+        for (const auto &Summary : VI.getSummaryList())
+          if ((FS = dyn_cast<FunctionSummary>(Summary->getBaseObject())))
+            break;
+    if (!FS) {
+      Out << "body not loaded";
+      return;
+    }
+    Out << FS->instCount() << " instructions, " << FS->calls().size()
+        << " calls (module summary)";
+    return;
+  }
+
+  unsigned NumInstructions = 0, NumCalls = 0;
+  for (const BasicBlock &BB : *F)
+    for (const Instruction &I : BB) {
+      ++NumInstructions;
+      if (isa<CallBase>(I))
+        ++NumCalls;
+    }
+  Out << F->size() << " blocks, " << NumInstructions << " instructions, "
+      << NumCalls << " calls";
+  if (PageStream)
+    Out << ", " << measureRenderedSize(F) << " bytes rendered";
+}
+
+/// measureRenderedSize - Return the bytes of HTML and styles of the full
+/// rendering of \p F, rendering it where nothing is written.
+uint64_t HTMLAssemblyWriter::measureRenderedSize(const Function *F) {
+  raw_null_ostream Null;
+  std::string Styles;
+  std::vector<std::pair<uint64_t, uint64_t>> Uses;
+  Out.flush();
+  uint64_t Begin = Out.tell();
+  raw_ostream &Page = PageStream->redirect(Null);
+  {
+    SaveAndRestore<std::string *> SaveStyles(CapturedStyles, &Styles);
+    SaveAndRestore<std::vector<std::pair<uint64_t, uint64_t>> *> SaveUses(
+        CapturedUses, &Uses);
+    SaveAndRestore<bool> SaveOutline(Options.Outline, false);
+    // Folded parts are measured in place rather than written to sidecar
+    // pages.
+    SaveAndRestore<std::string> SaveOutputPath(Options.OutputPath,
+                                               std::string());
+    printFunction(F);
+  }
+  Out.flush();
+  uint64_t Size = Out.tell() - Begin;
+  RecapturedBytes += Size;
+  PageStream->redirect(Page);
+  return Size + Styles.size();
+}
+
+/// Write the anchor of summary entry ^Slot.
+void HTMLAssemblyWriter::writeSummarySlotDef(int Slot) {
+  if (Slot == -1) {
+    Out << "^-1";
+    return;
+  }
+  writeDefOpen(Out, "sum", Slot);
+  Out << '^' << Slot << "</a>";
+}
+
+/// Write ^Slot as a link to its summary entry.
+void HTMLAssemblyWriter::writeSummarySlotRef(int Slot) {
+  if (Slot == -1) {
+    Out << "^-1";
+    return;
+  }
+  writeDefRefOpen(Out, "sum", Slot);
+  Out << '^' << Slot << "</a>";
+}
+
 void HTMLAssemblyWriter::printModuleSummaryIndex() {
   assert(TheIndex);
   int NumSlots = Machine.initializeIndexIfNeeded();
 
-  Out << "\n";
+  // The page is written in one pass, so the few style rules it needs are
+  // written inline (CSSOut is Out here) instead of being collected.
+  Out << "<!DOCTYPE html>\n";
+  Out << "<html>\n";
+  Out << "<head>\n";
+  Out << "<style>\n";
+  printHTMLMainStyles();
+  Out << "</style>\n";
+  Out << "<title>Summary index</title>\n";
+  Out << "</head>\n";
+  Out << "<body>\n";
+  Out << "<h1>";
+  printHTMLLink("Summary index", getSummaryDocURL());
+  Out << "</h1>\n";
+  Out << "<pre>\n";
 
   // Print module path entries. To print in order, add paths to a vector
   // indexed by module slot.
@@ -3316,7 +4643,8 @@ void HTMLAssemblyWriter::printModuleSummaryIndex() {
 
   unsigned i = 0;
   for (auto &ModPair : moduleVec) {
-    Out << "^" << i++ << " = module: (";
+    writeSummarySlotDef(i++);
+    Out << " = module: (";
     Out << "path: \"";
     printEscapedString(ModPair.first, Out);
     Out << "\", hash: (";
@@ -3326,15 +4654,8 @@ void HTMLAssemblyWriter::printModuleSummaryIndex() {
     Out << "))\n";
   }
 
-  // FIXME: Change AliasSummary to hold a ValueInfo instead of summary pointer
-  // for aliasee (then update BitcodeWriter.cpp and remove get/setAliaseeGUID).
-  for (auto &GlobalList : *TheIndex) {
-    auto GUID = GlobalList.first;
-    for (auto &Summary : GlobalList.second.SummaryList)
-      SummaryToGUIDMap[Summary.get()] = GUID;
-  }
-
-  // Print the global value summary entries.
+  // Print the global value summary entries. Their slots were assigned in this
+  // same order, so each entry is written out as soon as it is visited.
   for (auto &GlobalList : *TheIndex) {
     auto GUID = GlobalList.first;
     auto VI = TheIndex->getValueInfo(GlobalList);
@@ -3343,8 +4664,8 @@ void HTMLAssemblyWriter::printModuleSummaryIndex() {
 
   // Print the TypeIdMap entries.
   for (const auto &TID : TheIndex->typeIds()) {
-    Out << "^" << Machine.getTypeIdSlot(TID.second.first)
-        << " = typeid: (name: \"" << TID.second.first << "\"";
+    writeSummarySlotDef(Machine.getTypeIdSlot(TID.second.first));
+    Out << " = typeid: (name: \"" << TID.second.first << "\"";
     printTypeIdSummary(TID.second.second);
     Out << ") ; guid = " << TID.first << "\n";
   }
@@ -3352,20 +4673,25 @@ void HTMLAssemblyWriter::printModuleSummaryIndex() {
   // Print the TypeIdCompatibleVtableMap entries.
   for (auto &TId : TheIndex->typeIdCompatibleVtableMap()) {
     auto GUID = GlobalValue::getGUID(TId.first);
-    Out << "^" << Machine.getGUIDSlot(GUID)
-        << " = typeidCompatibleVTable: (name: \"" << TId.first << "\"";
+    writeSummarySlotDef(Machine.getGUIDSlot(GUID));
+    Out << " = typeidCompatibleVTable: (name: \"" << TId.first << "\"";
     printTypeIdCompatibleVtableSummary(TId.second);
     Out << ") ; guid = " << GUID << "\n";
   }
 
   // Don't emit flags when it's not really needed (value is zero by default).
   if (TheIndex->getFlags()) {
-    Out << "^" << NumSlots << " = flags: " << TheIndex->getFlags() << "\n";
+    writeSummarySlotDef(NumSlots);
+    Out << " = flags: " << TheIndex->getFlags() << "\n";
     ++NumSlots;
   }
 
-  Out << "^" << NumSlots << " = blockcount: " << TheIndex->getBlockCount()
-      << "\n";
+  writeSummarySlotDef(NumSlots);
+  Out << " = blockcount: " << TheIndex->getBlockCount() << "\n";
+
+  Out << "</pre>\n";
+  Out << "</body>\n";
+  Out << "</html>\n";
 }
 
 static const char *
@@ -3457,7 +4783,7 @@ void HTMLAssemblyWriter::printTypeIdCompatibleVtableSummary(
   for (auto &P : TI) {
     Out << FS;
     Out << "(offset: " << P.AddressPointOffset << ", ";
-    Out << "^" << Machine.getGUIDSlot(P.VTableVI.getGUID());
+    writeSummarySlotRef(Machine.getGUIDSlot(P.VTableVI.getGUID()));
     Out << ")";
   }
   Out << ")";
@@ -3525,7 +4851,7 @@ void HTMLAssemblyWriter::printAliasSummary(const AliasSummary *AS) {
   // aliasee summary (only if it is being imported directly). Handle
   // that case by just emitting "null" as the aliasee.
   if (AS->hasAliasee())
-    Out << "^" << Machine.getGUIDSlot(SummaryToGUIDMap[&AS->getAliasee()]);
+    writeSummarySlotRef(Machine.getGUIDSlot(AS->getAliaseeGUID()));
   else
     Out << "null";
 }
@@ -3545,8 +4871,9 @@ void HTMLAssemblyWriter::printGlobalVarSummary(const GlobalVarSummary *GS) {
     FieldSeparator FS;
     for (auto &P : VTableFuncs) {
       Out << FS;
-      Out << "(virtFunc: ^" << Machine.getGUIDSlot(P.FuncVI.getGUID())
-          << ", offset: " << P.VTableOffset;
+      Out << "(virtFunc: ";
+      writeSummarySlotRef(Machine.getGUIDSlot(P.FuncVI.getGUID()));
+      Out << ", offset: " << P.VTableOffset;
       Out << ")";
     }
     Out << ")";
@@ -3612,7 +4939,8 @@ void HTMLAssemblyWriter::printFunctionSummary(const FunctionSummary *FS) {
     FieldSeparator IFS;
     for (auto &Call : FS->calls()) {
       Out << IFS;
-      Out << "(callee: ^" << Machine.getGUIDSlot(Call.first.getGUID());
+      Out << "(callee: ";
+      writeSummarySlotRef(Machine.getGUIDSlot(Call.first.getGUID()));
       if (Call.second.getHotness() != CalleeInfo::HotnessType::Unknown)
         Out << ", hotness: " << getHotnessName(Call.second.getHotness());
       else if (Call.second.RelBlockFreq)
@@ -3675,9 +5003,10 @@ void HTMLAssemblyWriter::printFunctionSummary(const FunctionSummary *FS) {
     FieldSeparator SNFS;
     for (auto &CI : FS->callsites()) {
       Out << SNFS;
-      if (CI.Callee)
-        Out << "(callee: ^" << Machine.getGUIDSlot(CI.Callee.getGUID());
-      else
+      if (CI.Callee) {
+        Out << "(callee: ";
+        writeSummarySlotRef(Machine.getGUIDSlot(CI.Callee.getGUID()));
+      } else
         Out << "(callee: null";
       Out << ", clones: (";
       FieldSeparator VFS;
@@ -3713,7 +5042,8 @@ void HTMLAssemblyWriter::printFunctionSummary(const FunctionSummary *FS) {
         FieldSeparator IFS;
         for (auto &Call : PS.Calls) {
           Out << IFS;
-          Out << "(callee: ^" << Machine.getGUIDSlot(Call.Callee.getGUID());
+          Out << "(callee: ";
+          writeSummarySlotRef(Machine.getGUIDSlot(Call.Callee.getGUID()));
           Out << ", param: " << Call.ParamNo;
           Out << ", offset: ";
           PrintRange(Call.Offsets);
@@ -3747,7 +5077,7 @@ void HTMLAssemblyWriter::printTypeIdInfo(
         Out << FS;
         auto Slot = Machine.getTypeIdSlot(It->second.first);
         assert(Slot != -1);
-        Out << "^" << Slot;
+        writeSummarySlotRef(Slot);
       }
     }
     Out << ")";
@@ -3789,7 +5119,7 @@ void HTMLAssemblyWriter::printVFuncId(const FunctionSummary::VFuncId VFId) {
     Out << "vFuncId: (";
     auto Slot = Machine.getTypeIdSlot(It->second.first);
     assert(Slot != -1);
-    Out << "^" << Slot;
+    writeSummarySlotRef(Slot);
     Out << ", offset: " << VFId.Offset;
     Out << ")";
   }
@@ -3828,8 +5158,9 @@ void HTMLAssemblyWriter::printSummary(const GlobalValueSummary &Summary) {
   GlobalValueSummary::GVFlags GVFlags = Summary.flags();
   GlobalValue::LinkageTypes LT = (GlobalValue::LinkageTypes)GVFlags.Linkage;
   Out << getSummaryKindName(Summary.getSummaryKind()) << ": ";
-  Out << "(module: ^" << Machine.getModulePathSlot(Summary.modulePath())
-      << ", flags: (";
+  Out << "(module: ";
+  writeSummarySlotRef(Machine.getModulePathSlot(Summary.modulePath()));
+  Out << ", flags: (";
   Out << "linkage: " << getLinkageName(LT);
   Out << ", visibility: "
       << getVisibilityName((GlobalValue::VisibilityTypes)GVFlags.Visibility);
@@ -3856,7 +5187,7 @@ void HTMLAssemblyWriter::printSummary(const GlobalValueSummary &Summary) {
         Out << "readonly ";
       else if (Ref.isWriteOnly())
         Out << "writeonly ";
-      Out << "^" << Machine.getGUIDSlot(Ref.getGUID());
+      writeSummarySlotRef(Machine.getGUIDSlot(Ref.getGUID()));
     }
     Out << ")";
   }
@@ -3865,7 +5196,8 @@ void HTMLAssemblyWriter::printSummary(const GlobalValueSummary &Summary) {
 }
 
 void HTMLAssemblyWriter::printSummaryInfo(unsigned Slot, const ValueInfo &VI) {
-  Out << "^" << Slot << " = gv: (";
+  writeSummarySlotDef(Slot);
+  Out << " = gv: (";
   if (!VI.name().empty())
     Out << "name: \"" << VI.name() << "\"";
   else
@@ -3907,6 +5239,7 @@ static void printMetadataIdentifier(StringRef Name,
 }
 
 void HTMLAssemblyWriter::printNamedMDNode(const NamedMDNode *NMD) {
+  auto WriterCtx = getContext();
   Out << '!';
   printMetadataIdentifier(NMD->getName(), Out);
   Out << " = !{";
@@ -3928,7 +5261,7 @@ void HTMLAssemblyWriter::printNamedMDNode(const NamedMDNode *NMD) {
     if (Slot == -1)
       Out << "<badref>";
     else
-      Out << '!' << Slot;
+      writeMetadataSlotRef(Out, Slot, WriterCtx);
   }
   Out << "}\n";
 }
@@ -3989,21 +5322,33 @@ static StringRef getUnnamedAddrEncoding(GlobalVariable::UnnamedAddr UA) {
   llvm_unreachable("Unknown UnnamedAddr");
 }
 
+/// Print the comdat of \p GO, if any, linked to the definition anchored at
+/// \p ComdatId unless that is -1.
 static void maybePrintComdat(formatted_raw_ostream &Out,
-                             const GlobalObject &GO) {
+                             const GlobalObject &GO, int ComdatId = -1) {
   const Comdat *C = GO.getComdat();
   if (!C)
     return;
 
   if (isa<GlobalVariable>(GO))
     Out << ',';
-  Out << " comdat";
+  Out << ' ';
 
-  if (GO.getName() == C->getName())
+  if (GO.getName() == C->getName()) {
+    if (ComdatId != -1)
+      writeDefRefOpen(Out, "comdat", ComdatId);
+    Out << "comdat";
+    if (ComdatId != -1)
+      Out << "</a>";
     return;
+  }
 
-  Out << '(';
+  Out << "comdat(";
+  if (ComdatId != -1)
+    writeDefRefOpen(Out, "comdat", ComdatId);
   PrintLLVMName(Out, C->getName(), ComdatPrefix);
+  if (ComdatId != -1)
+    Out << "</a>";
   Out << ')';
 }
 
@@ -4011,6 +5356,8 @@ void HTMLAssemblyWriter::printGlobal(const GlobalVariable *GV) {
   if (GV->isMaterializable())
     Out << "; Materializable\n";
 
+  printExternalDefinitionLink(GV);
+  printGlobalAnchor(GV);
   AsmWriterContext WriterCtx(&TypePrinter, &Machine, GV->getParent());
   WriteAsOperandInternal2(Out, GV, WriterCtx, true);
   Out << " = ";
@@ -4033,9 +5380,15 @@ void HTMLAssemblyWriter::printGlobal(const GlobalVariable *GV) {
   Out << (GV->isConstant() ? "constant " : "global ");
   TypePrinter.print(GV->getValueType(), Out);
 
+  bool IsInitializerElided = false;
+  std::optional<uint64_t> ElidedInitializerHash;
   if (GV->hasInitializer()) {
     Out << ' ';
-    writeOperand(GV->getInitializer(), false);
+    IsInitializerElided = shouldElideInitializer(GV);
+    if (IsInitializerElided)
+      ElidedInitializerHash = printElidedInitializer(GV);
+    else
+      writeOperand(GV->getInitializer(), false);
   }
 
   if (GV->hasSection()) {
@@ -4062,7 +5415,7 @@ void HTMLAssemblyWriter::printGlobal(const GlobalVariable *GV) {
       Out << ", sanitize_address_dyninit";
   }
 
-  maybePrintComdat(Out, *GV);
+  maybePrintComdat(Out, *GV, getComdatId(GV->getComdat()));
   if (MaybeAlign A = GV->getAlign())
     Out << ", align " << A->value();
 
@@ -4072,15 +5425,262 @@ void HTMLAssemblyWriter::printGlobal(const GlobalVariable *GV) {
 
   auto Attrs = GV->getAttributes();
   if (Attrs.hasAttributes())
-    Out << " #" << Machine.getAttributeGroupSlot(Attrs);
+    writeAttributeGroupRef(Attrs);
+
+  if (IsInitializerElided) {
+    Out << " ; elided initializer: "
+        << GV->getParent()->getDataLayout().getTypeAllocSize(
+               GV->getValueType())
+        << " bytes";
+    if (ElidedInitializerHash)
+      Out << ", xxhash " << format_hex(*ElidedInitializerHash, 18);
+  }
 
   printInfoComment(*GV);
 }
 
+/// shouldElideInitializer - Return true if the initializer of \p GV is an
+/// aggregate larger than the --max-initializer-bytes budget.
+bool HTMLAssemblyWriter::shouldElideInitializer(const GlobalVariable *GV) {
+  if (!Options.MaxInitializerBytes || !GV->getParent())
+    return false;
+
+  const Constant *Init = GV->getInitializer();
+  if (!isa<ConstantDataSequential>(Init) && !isa<ConstantAggregate>(Init))
+    return false;
+
+  const DataLayout &DL = GV->getParent()->getDataLayout();
+  return DL.getTypeAllocSize(GV->getValueType()) > Options.MaxInitializerBytes;
+}
+
+/// printElidedInitializer - Print the first few elements of the initializer
+/// of \p GV followed by a link to a sidecar file holding the whole constant.
+/// Returns the hash of the full initializer text, if it was rendered for a
+/// sidecar. Without a page to put the sidecar next to, only the preview is
+/// rendered.
+std::optional<uint64_t>
+HTMLAssemblyWriter::printElidedInitializer(const GlobalVariable *GV) {
+  const unsigned NumPreviewElements = 8;
+  const unsigned NumPreviewChars = 64;
+
+  const Constant *Init = GV->getInitializer();
+  std::optional<uint64_t> Hash;
+  std::string SidecarName;
+  if (!Options.OutputPath.empty()) {
+    std::string Body;
+    raw_string_ostream BodyOS(Body);
+    // The full text goes to a plain .ll sidecar, so it is rendered without
+    // links.
+    TypePrinting PlainTypePrinter;
+    PlainTypePrinter.copyNumbering(TypePrinter);
+    PlainTypePrinter.setLinkNames(false);
+    auto WriterCtx = getContext();
+    WriterCtx.TypePrinter = &PlainTypePrinter;
+    WriterCtx.MetadataURL = nullptr;
+    WriteConstantInternal(BodyOS, Init, WriterCtx);
+    BodyOS << '\n';
+    Hash = xxHash64(BodyOS.str());
+    SidecarName = writeInitializerSidecar(Body);
+  }
+
+  auto PrintRemainder = [&](uint64_t Remaining, StringRef What) {
+    std::string Text = "... " + std::to_string(Remaining) + " more " +
+                       What.str();
+    if (SidecarName.empty())
+      Out << Text;
+    else
+      printHTMLLink(Text, SidecarName);
+  };
+
+  const auto *CDS = dyn_cast<ConstantDataSequential>(Init);
+  if (CDS && CDS->isString()) {
+    StringRef Str = CDS->getAsString();
+    Out << "c\"";
+    printEscapedString(Str.take_front(NumPreviewChars), Out);
+    Out << '"';
+    if (Str.size() > NumPreviewChars) {
+      Out << ' ';
+      PrintRemainder(Str.size() - NumPreviewChars, "bytes");
+    }
+    return Hash;
+  }
+
+  unsigned NumElements =
+      CDS ? CDS->getNumElements() : Init->getNumOperands();
+  StringRef Open = "[", Close = "]";
+  if (auto *STy = dyn_cast<StructType>(Init->getType())) {
+    Open = STy->isPacked() ? "<{ " : "{ ";
+    Close = STy->isPacked() ? " }>" : " }";
+  } else if (Init->getType()->isVectorTy()) {
+    Open = "<";
+    Close = ">";
+  }
+
+  Out << Open;
+  unsigned NumPrinted = std::min(NumElements, NumPreviewElements);
+  for (unsigned I = 0; I != NumPrinted; ++I) {
+    if (I)
+      Out << ", ";
+    writeOperand(Init->getAggregateElement(I), true);
+  }
+  if (NumElements > NumPrinted) {
+    Out << ", ";
+    PrintRemainder(NumElements - NumPrinted, "elements");
+  }
+  Out << Close;
+  return Hash;
+}
+
+/// writeInitializerSidecar - Write \p Body to a file next to the page and
+/// return the name to link it by, or an empty string if there is no page to
+/// put it next to or the file could not be written.
+std::string HTMLAssemblyWriter::writeInitializerSidecar(StringRef Body) {
+  if (Options.OutputPath.empty())
+    return "";
+
+  std::string Path = Options.OutputPath + ".init" +
+                     std::to_string(NumInitializerSidecars++) + ".ll";
+  std::error_code EC;
+  raw_fd_ostream SidecarOS(Path, EC, sys::fs::OF_Text);
+  if (EC) {
+    WithColor::warning() << Path << ": " << EC.message() << '\n';
+    return "";
+  }
+  SidecarOS << Body;
+  addSidecar(Path);
+  return std::string(sys::path::filename(Path));
+}
+
+/// getUnfoldedCount - Return how many of the \p NumParts parts of a construct
+/// are printed under \p Budget, zero meaning no budget.
+static unsigned getUnfoldedCount(unsigned NumParts, unsigned Budget) {
+  return Budget && NumParts > Budget ? Budget : NumParts;
+}
+
+/// printFolded - Print \p Summary in place of the parts of a construct past
+/// its budget, which \p PrintRest prints: to the sidecar page \p Name next
+/// to the page, which the summary links to, or, when there is no page to put
+/// it next to, into a collapsed region of the page.
+void HTMLAssemblyWriter::printFolded(const Twine &Name, const Twine &Summary,
+                                     function_ref<void()> PrintRest) {
+  if (!canWriteFoldedPages()) {
+    Out << "<details><summary>" << Summary << "</summary>";
+    PrintRest();
+    Out << "</details>";
+    return;
+  }
+
+  std::string URL = getFoldedPageURL(Name);
+  std::string Path = Options.OutputPath + "." + Name.str() + ".html";
+  std::error_code EC;
+  raw_fd_ostream FoldOS(Path, EC, sys::fs::OF_Text);
+  if (EC) {
+    WithColor::warning() << Path << ": " << EC.message() << '\n';
+    Out << Summary;
+    return;
+  }
+  addSidecar(Path);
+  FoldOS << "<!DOCTYPE html>\n";
+  FoldOS << "<html>\n";
+  FoldOS << "<head>\n";
+  // The references to the rest of the page resolve against it.
+  FoldOS << "<base href=\"";
+  printHTMLEscaped(FoldOS, getPageURL());
+  FoldOS << "\">\n";
+  if (!Options.StyleSheetURL.empty())
+    FoldOS << "<link rel=\"stylesheet\" href=\"" << Options.StyleSheetURL
+           << "\">\n";
+  FoldOS << "<style>\n";
+  FoldOS << "a:link, a:visited { color:black; text-decoration:none; }\n";
+  FoldOS << "a[tag]:target { background-color: #ffa; }\n";
+  FoldOS << "</style>\n";
+  FoldOS << "<title>";
+  printHTMLEscaped(FoldOS, Summary.str());
+  FoldOS << "</title>\n";
+  FoldOS << "</head>\n";
+  FoldOS << "<body>\n";
+  FoldOS << "<pre>";
+
+  // Folded parts nested in this one add their own bytes to RecapturedBytes.
+  Out.flush();
+  uint64_t Begin = Out.tell();
+  uint64_t Recaptured = RecapturedBytes;
+  raw_ostream &Page = PageStream->redirect(FoldOS);
+  {
+    SaveAndRestore<std::string> SaveFoldedPageURL(FoldedPageURL, URL);
+    PrintRest();
+  }
+  Out.flush();
+  RecapturedBytes = Recaptured + (Out.tell() - Begin);
+  PageStream->redirect(Page);
+
+  FoldOS << "\n</pre>\n";
+  FoldOS << "</body>\n";
+  FoldOS << "</html>\n";
+  FoldOS.close();
+  if (FoldOS.has_error()) {
+    WithColor::warning() << Path << ": " << FoldOS.error().message() << '\n';
+    FoldOS.clear_error();
+  }
+  printHTMLLink(Summary.str(), URL);
+}
+
+/// collectFoldedDefinitions - Record the sidecar page of each instruction of
+/// \p F past the MaxBlockInstructions budget, so that references to them link
+/// there.
+void HTMLAssemblyWriter::collectFoldedDefinitions(const Function *F) {
+  FoldedDefinitionPages.clear();
+  FoldedDefinitionPageOf.clear();
+  if (!Options.MaxBlockInstructions || !canWriteFoldedPages())
+    return;
+
+  for (const BasicBlock &BB : *F) {
+    auto I = BB.begin(), E = BB.end();
+    for (unsigned N = 0; I != E && N != Options.MaxBlockInstructions; ++N)
+      ++I;
+    if (I == E)
+      continue;
+    FoldedDefinitionPages.push_back(
+        getFoldedPageURL(getHTMLId(getHTMLTag(&BB))));
+    for (; I != E; ++I)
+      FoldedDefinitionPageOf[getHTMLTag(&*I)] =
+          FoldedDefinitionPages.size() - 1;
+  }
+}
+
+/// hasFoldedConstructs - Return true if any construct of \p F is over its
+/// budget.
+bool HTMLAssemblyWriter::hasFoldedConstructs(const Function *F) {
+  if (!Options.hasFoldBudgets())
+    return false;
+
+  auto IsOver = [](unsigned NumParts, unsigned Budget) {
+    return getUnfoldedCount(NumParts, Budget) != NumParts;
+  };
+  for (const BasicBlock &BB : *F) {
+    if (Options.MaxPredecessors && !BB.isEntryBlock() &&
+        IsOver(pred_size(&BB), Options.MaxPredecessors))
+      return true;
+    unsigned NumInstructions = 0;
+    for (const Instruction &I : BB) {
+      if (IsOver(++NumInstructions, Options.MaxBlockInstructions))
+        return true;
+      if (const auto *SI = dyn_cast<SwitchInst>(&I))
+        if (IsOver(SI->getNumCases(), Options.MaxSwitchCases))
+          return true;
+      if (const auto *PN = dyn_cast<PHINode>(&I))
+        if (IsOver(PN->getNumIncomingValues(), Options.MaxPhiIncoming))
+          return true;
+    }
+  }
+  return false;
+}
+
 void HTMLAssemblyWriter::printAlias(const GlobalAlias *GA) {
   if (GA->isMaterializable())
     Out << "; Materializable\n";
 
+  printGlobalAnchor(GA);
   AsmWriterContext WriterCtx(&TypePrinter, &Machine, GA->getParent());
   WriteAsOperandInternal(Out, GA, WriterCtx);
   Out << " = ";
@@ -4150,8 +5750,95 @@ void HTMLAssemblyWriter::printIFunc(const GlobalIFunc *GI) {
   Out << '\n';
 }
 
+/// Return the path of \p To relative to the directory containing \p From,
+/// with '/' separators. Both paths are absolute.
+static std::string getRelativePath(StringRef From, StringRef To) {
+  SmallVector<StringRef, 16> FromParts(
+      sys::path::begin(sys::path::parent_path(From)),
+      sys::path::end(sys::path::parent_path(From)));
+  SmallVector<StringRef, 16> ToParts(sys::path::begin(To), sys::path::end(To));
+
+  size_t Common = 0;
+  while (Common != FromParts.size() && Common + 1 < ToParts.size() &&
+         FromParts[Common] == ToParts[Common])
+    ++Common;
+
+  std::string Path;
+  for (size_t I = Common, E = FromParts.size(); I != E; ++I)
+    Path += "../";
+  for (size_t I = Common, E = ToParts.size(); I != E; ++I) {
+    if (I != Common)
+      Path += '/';
+    Path += ToParts[I];
+  }
+  return Path;
+}
+
+/// Return the URL of the definition of \p GV if this page only declares or
+/// imports it and another page of the site defines it, or an empty string.
+std::string HTMLAssemblyWriter::getExternalDefinitionURL(const GlobalValue *GV) {
+  // On a function page, the other functions of the module are on theirs.
+  if (!Options.FunctionPageURLPrefix.empty()) {
+    const auto *F = dyn_cast<Function>(GV);
+    if (F && !F->isDeclaration() && F != Machine.getFunction())
+      return Options.FunctionPageURLPrefix + std::to_string(F->getGUID());
+  }
+
+  const CrossModuleSymbolTable *Symbols = Options.Symbols;
+  if (!Symbols || !GV->hasName() ||
+      (!GV->isDeclaration() && !GV->hasAvailableExternallyLinkage()))
+    return "";
+
+  auto I = Symbols->DefiningPage.find(GV->getGUID());
+  if (I == Symbols->DefiningPage.end())
+    return "";
+
+  if (SymbolPageURLs.empty()) {
+    SmallString<256> Self(Options.OutputPath);
+    sys::fs::make_absolute(Self);
+    for (const std::string &Page : Symbols->Pages)
+      SymbolPageURLs.push_back(Page == Self ? std::string()
+                                            : getRelativePath(Self, Page));
+  }
+  const std::string &Page = SymbolPageURLs[I->second];
+  if (Page.empty())
+    return "";
+  return Page + "#gv" + std::to_string(GV->getGUID());
+}
+
+/// Print a comment line linking a declared or imported global to the page
+/// that defines it.
+void HTMLAssemblyWriter::printExternalDefinitionLink(const GlobalValue *GV) {
+  std::string URL = getExternalDefinitionURL(GV);
+  if (URL.empty())
+    return;
+  Out << "; ";
+  printHTMLLink(GV->isDeclaration() ? "defined in another module"
+                                    : "original definition",
+                URL);
+  Out << '\n';
+}
+
+/// Anchor the definition of \p GV by GUID so that other pages can link to it.
+void HTMLAssemblyWriter::printGlobalAnchor(const GlobalValue *GV) {
+  if (!Options.Symbols || !GV->hasName() || GV->isDeclaration() ||
+      GV->hasAvailableExternallyLinkage())
+    return;
+  Out << "<a id=\"gv" << GV->getGUID() << "\"></a>";
+}
+
 void HTMLAssemblyWriter::printComdat(const Comdat *C) {
-  C->print(Out);
+  std::string Name;
+  raw_string_ostream NameOS(Name);
+  PrintLLVMName(NameOS, C->getName(), ComdatPrefix);
+
+  std::string Text;
+  raw_string_ostream TextOS(Text);
+  C->print(TextOS);
+
+  // Comdat::print starts with the name; anchor that part.
+  writeDefOpen(Out, "comdat", getComdatId(C));
+  Out << NameOS.str() << "</a>" << StringRef(TextOS.str()).drop_front(Name.size());
 }
 
 void HTMLAssemblyWriter::printTypeIdentities() {
@@ -4163,7 +5850,8 @@ void HTMLAssemblyWriter::printTypeIdentities() {
   // Emit all numbered types.
   auto &NumberedTypes = TypePrinter.getNumberedTypes();
   for (unsigned I = 0, E = NumberedTypes.size(); I != E; ++I) {
-    Out << '%' << I << " = type ";
+    writeDefOpen(Out, "ty", I);
+    Out << '%' << I << "</a> = type ";
 
     // Make sure we print out at least one level of the type structure, so
     // that we do not get %2 = type %2
@@ -4173,8 +5861,9 @@ void HTMLAssemblyWriter::printTypeIdentities() {
 
   auto &NamedTypes = TypePrinter.getNamedTypes();
   for (StructType *NamedType : NamedTypes) {
+    writeDefOpen(Out, "ty", TypePrinter.getTypeAnchor(NamedType));
     PrintLLVMName(Out, NamedType->getName(), LocalPrefix);
-    Out << " = type ";
+    Out << "</a> = type ";
 
     // Make sure we print out at least one level of the type structure, so
     // that we do not get %FILE = type %FILE
@@ -4192,22 +5881,19 @@ void HTMLAssemblyWriter::printFunction(const Function *F) {
 
   const AttributeList &Attrs = F->getAttributes();
   if (Attrs.hasFnAttrs()) {
-    AttributeSet AS = Attrs.getFnAttrs();
-    std::string AttrStr;
-
-    for (const Attribute &Attr : AS) {
-      if (!Attr.isStringAttribute()) {
-        if (!AttrStr.empty()) AttrStr += ' ';
-        AttrStr += Attr.getAsString();
-      }
-    }
-
+    const std::string &AttrStr =
+        getAttributeSetString(Attrs.getFnAttrs(), ASK_FnComment);
     if (!AttrStr.empty())
       Out << "; Function Attrs: " << AttrStr << '\n';
   }
 
+  SaveAndRestore<uint64_t> SavedLinkIdBase(LinkIdBase, getHTMLTag(F));
+  SaveAndRestore<uint64_t> SavedNumLinkIds(NumLinkIds, 0);
   Machine.incorporateFunction(F);
+  collectFoldedDefinitions(F);
 
+  printExternalDefinitionLink(F);
+  printGlobalAnchor(F);
   if (F->isDeclaration()) {
     Out << "declare";
     SmallVector<std::pair<unsigned, MDNode *>, 4> MDs;
@@ -4230,7 +5916,7 @@ void HTMLAssemblyWriter::printFunction(const Function *F) {
 
   FunctionType *FT = F->getFunctionType();
   if (Attrs.hasRetAttrs())
-    Out << Attrs.getAsString(AttributeList::ReturnIndex) << ' ';
+    Out << getAttributeSetString(Attrs.getRetAttrs(), ASK_Return) << ' ';
   TypePrinter.print(F->getReturnType(), Out);
   AsmWriterContext WriterCtx(&TypePrinter, &Machine, F->getParent());
   Out << ' ';
@@ -4283,7 +5969,7 @@ void HTMLAssemblyWriter::printFunction(const Function *F) {
       Mod->getDataLayout().getProgramAddressSpace() != 0)
     Out << " addrspace(" << F->getAddressSpace() << ")";
   if (Attrs.hasFnAttrs())
-    Out << " #" << Machine.getAttributeGroupSlot(Attrs.getFnAttrs());
+    writeAttributeGroupRef(Attrs.getFnAttrs());
   if (F->hasSection()) {
     Out << " section \"";
     printEscapedString(F->getSection(), Out);
@@ -4294,7 +5980,7 @@ void HTMLAssemblyWriter::printFunction(const Function *F) {
     printEscapedString(F->getPartition(), Out);
     Out << '"';
   }
-  maybePrintComdat(Out, *F);
+  maybePrintComdat(Out, *F, getComdatId(F->getComdat()));
   if (MaybeAlign A = F->getAlign())
     Out << " align " << A->value();
   if (F->hasGC())
@@ -4320,12 +6006,18 @@ void HTMLAssemblyWriter::printFunction(const Function *F) {
     printMetadataAttachments(MDs, " ");
 
     Out << " {";
-    // Output all of the function's basic blocks.
-    for (const BasicBlock &BB : *F)
-      printBasicBlock(&BB);
+    if (Options.Outline) {
+      Out << "\n  ; ";
+      printOutlineSummary(F);
+      Out << '\n';
+    } else {
+      // Output all of the function's basic blocks.
+      for (const BasicBlock &BB : *F)
+        printBasicBlock(&BB);
 
-    // Output the function's use-lists.
-    printUseLists(F);
+      // Output the function's use-lists.
+      printUseLists(F);
+    }
 
     Out << "}\n";
   }
@@ -4333,6 +6025,273 @@ void HTMLAssemblyWriter::printFunction(const Function *F) {
   Machine.purgeFunction();
 }
 
+void HTMLAssemblyWriter::enableRenderCache() {
+  // Annotations and use-list orders are not covered by the cache keys.
+  if (AnnotationWriter || ShouldPreserveUseListOrder || !PageStream)
+    return;
+  // The pack is found again by the page it belongs to, or by the module
+  // when the page goes to stdout.
+  std::string PageKey = Options.OutputPath.empty()
+                            ? TheModule->getModuleIdentifier()
+                            : Options.OutputPath;
+  RenderCache = std::make_unique<FunctionRenderCache>(Options.CacheDir,
+                                                      PageKey);
+}
+
+void HTMLAssemblyWriter::saveRenderCache() {
+  if (RenderCache)
+    RenderCache->save();
+}
+
+/// printCachedFunction - Print \p F, copying its rendering from the render
+/// cache if neither it nor anything its rendering depends on has changed.
+void HTMLAssemblyWriter::printCachedFunction(const Function *F) {
+  // Folded constructs write sidecar pages, which a hit would not. Outlines
+  // are not cached.
+  if (!RenderCache || F->isDeclaration() || Options.Outline ||
+      hasFoldedConstructs(F)) {
+    if (Options.Stats && !F->isDeclaration())
+      ++Options.Stats->FunctionsRendered;
+    printFunction(F);
+    return;
+  }
+
+  // Numbering the function also numbers the metadata and attribute groups it
+  // is the first to use, which the rest of the page relies on even on a hit.
+  Machine.incorporateFunction(F);
+  Machine.initializeIfNeeded();
+  std::string Key = getFunctionCacheKey(F);
+  Machine.purgeFunction();
+
+  StringRef Text, Styles, Uses;
+  if (RenderCache->lookup(Key, Text, Styles, Uses)) {
+    if (Options.Stats)
+      ++Options.Stats->FunctionsReused;
+    Out << Text;
+    CSSOut << Styles;
+    for (size_t I = 0; I + 16 <= Uses.size(); I += 16)
+      DefToUseMap[support::endian::read64le(Uses.data() + I)].insert(
+          support::endian::read64le(Uses.data() + I + 8));
+    return;
+  }
+
+  // Render into a string, capturing what the links of the function add to
+  // the stylesheet, and store all of it.
+  if (Options.Stats)
+    ++Options.Stats->FunctionsRendered;
+  std::string RenderedText, RenderedStyles;
+  std::vector<std::pair<uint64_t, uint64_t>> RenderedUses;
+  raw_string_ostream TextOS(RenderedText);
+  Out.flush();
+  raw_ostream &Page = PageStream->redirect(TextOS);
+  CapturedStyles = &RenderedStyles;
+  CapturedUses = &RenderedUses;
+  printFunction(F);
+  CapturedStyles = nullptr;
+  CapturedUses = nullptr;
+  Out.flush();
+  PageStream->redirect(Page);
+  TextOS.flush();
+  RecapturedBytes += RenderedText.size();
+
+  RenderCache->store(Key, RenderedText, RenderedStyles, RenderedUses);
+  Out << RenderedText;
+  CSSOut << RenderedStyles;
+  for (const auto &Use : RenderedUses)
+    DefToUseMap[Use.first].insert(Use.second);
+}
+
+/// getFunctionCacheKey - Return the render cache key of \p F: a hash of its
+/// structure together with the names, slots and anchors of the types,
+/// globals, metadata and attribute groups it refers to, that is of everything
+/// its rendering depends on. \p F must be incorporated into Machine.
+std::string HTMLAssemblyWriter::getFunctionCacheKey(const Function *F) {
+  raw_sha1_ostream Hash;
+  // Bump the version whenever the markup of functions changes.
+  Hash << "llvm-html function 1\n";
+  Hash << IsForDebug << ' ' << (Options.Symbols != nullptr) << ' '
+       << MetadataURL << ' '
+       << TheModule->getDataLayout().getProgramAddressSpace() << '\n';
+
+  const AttributeList &Attrs = F->getAttributes();
+  Hash << F->isMaterializable() << ' ' << F->getLinkage() << ' '
+       << F->isDSOLocal() << ' ' << F->getVisibility() << ' '
+       << F->getDLLStorageClass() << ' ' << F->getCallingConv() << ' '
+       << unsigned(F->getUnnamedAddr()) << ' ' << F->getAddressSpace() << '\n';
+  if (Attrs.hasFnAttrs())
+    Hash << getAttributeSetString(Attrs.getFnAttrs(), ASK_FnComment) << " #"
+         << Machine.getAttributeGroupSlot(Attrs.getFnAttrs());
+  Hash << '\n';
+  if (Attrs.hasRetAttrs())
+    Hash << getAttributeSetString(Attrs.getRetAttrs(), ASK_Return);
+  Hash << '\n';
+  TypePrinter.print(F->getFunctionType(), Hash);
+  Hash << ' ';
+  hashOperand(Hash, F);
+  for (const Argument &Arg : F->args()) {
+    AttributeSet ArgAttrs = Attrs.getParamAttrs(Arg.getArgNo());
+    if (ArgAttrs.hasAttributes())
+      Hash << getAttributeSetString(ArgAttrs, ASK_Plain) << ' ';
+    hashOperand(Hash, &Arg);
+  }
+
+  Hash << F->getSection() << '\n' << F->getPartition() << '\n';
+  if (const Comdat *C = F->getComdat())
+    Hash << getComdatId(C) << ' ' << C->getName();
+  Hash << '\n';
+  if (MaybeAlign A = F->getAlign())
+    Hash << A->value();
+  Hash << '\n';
+  if (F->hasGC())
+    Hash << F->getGC();
+  Hash << '\n';
+  hashOperand(Hash, F->hasPrefixData() ? F->getPrefixData() : nullptr);
+  hashOperand(Hash, F->hasPrologueData() ? F->getPrologueData() : nullptr);
+  hashOperand(Hash, F->hasPersonalityFn() ? F->getPersonalityFn() : nullptr);
+  SmallVector<std::pair<unsigned, MDNode *>, 4> MDs;
+  F->getAllMetadata(MDs);
+  hashMetadataAttachments(Hash, MDs);
+
+  for (const BasicBlock &BB : *F) {
+    Hash << "block ";
+    hashOperand(Hash, &BB);
+    for (const Instruction &I : BB)
+      hashInstruction(Hash, I);
+  }
+
+  return toHex(Hash.sha1(), /*LowerCase=*/true);
+}
+
+/// hashOperand - Hash \p V for getFunctionCacheKey the way it is printed as
+/// an operand, including the page a global reference links to.
+void HTMLAssemblyWriter::hashOperand(raw_ostream &Hash, const Value *V) {
+  if (!V) {
+    Hash << "<null>\n";
+    return;
+  }
+  TypePrinter.print(V->getType(), Hash);
+  Hash << ' ';
+  AsmWriterContext WriterCtx = getContext();
+  WriteAsOperandInternal(Hash, V, WriterCtx);
+  if (const auto *GV = dyn_cast<GlobalValue>(V))
+    Hash << ' ' << getExternalDefinitionURL(GV);
+  Hash << '\n';
+}
+
+void HTMLAssemblyWriter::hashMetadataAttachments(
+    raw_ostream &Hash,
+    const SmallVectorImpl<std::pair<unsigned, MDNode *>> &MDs) {
+  if (MDs.empty())
+    return;
+
+  if (MDNames.empty())
+    MDs[0].second->getContext().getMDKindNames(MDNames);
+
+  auto WriterCtx = getContext();
+  for (const auto &I : MDs) {
+    // Custom kinds are numbered in the order they are seen, so it is their
+    // name, which is what gets printed, that identifies them.
+    if (I.first < MDNames.size())
+      Hash << '!' << MDNames[I.first] << ' ';
+    else
+      Hash << "!#" << I.first << ' ';
+    WriteAsOperandInternal(Hash, I.second, WriterCtx);
+    Hash << '\n';
+  }
+}
+
+/// hashInstruction - Hash \p I for getFunctionCacheKey: its operands as they
+/// are printed, plus whatever the printer takes from the instruction itself.
+void HTMLAssemblyWriter::hashInstruction(raw_ostream &Hash,
+                                         const Instruction &I) {
+  Hash << I.getOpcodeName() << ' ' << I.getRawSubclassOptionalData() << ' ';
+  if (I.getType()->isVoidTy())
+    Hash << "void\n";
+  else
+    hashOperand(Hash, &I);
+  for (const Value *Op : I.operands())
+    hashOperand(Hash, Op);
+
+  auto HashSyncScope = [&](SyncScope::ID SSID) {
+    if (SSNs.empty())
+      I.getContext().getSyncScopeNames(SSNs);
+    Hash << ' ' << SSID;
+    if (SSID < SSNs.size())
+      Hash << ' ' << SSNs[SSID];
+  };
+
+  if (const auto *CI = dyn_cast<CmpInst>(&I)) {
+    Hash << CI->getPredicate();
+  } else if (const auto *LI = dyn_cast<LoadInst>(&I)) {
+    Hash << LI->isVolatile() << ' ' << LI->getAlign().value() << ' '
+         << unsigned(LI->getOrdering());
+    HashSyncScope(LI->getSyncScopeID());
+  } else if (const auto *SI = dyn_cast<StoreInst>(&I)) {
+    Hash << SI->isVolatile() << ' ' << SI->getAlign().value() << ' '
+         << unsigned(SI->getOrdering());
+    HashSyncScope(SI->getSyncScopeID());
+  } else if (const auto *AI = dyn_cast<AllocaInst>(&I)) {
+    TypePrinter.print(AI->getAllocatedType(), Hash);
+    Hash << ' ' << AI->getAlign().value() << ' ' << AI->isUsedWithInAlloca()
+         << ' ' << AI->isSwiftError();
+  } else if (const auto *FI = dyn_cast<FenceInst>(&I)) {
+    Hash << unsigned(FI->getOrdering());
+    HashSyncScope(FI->getSyncScopeID());
+  } else if (const auto *CXI = dyn_cast<AtomicCmpXchgInst>(&I)) {
+    Hash << CXI->isWeak() << ' ' << CXI->isVolatile() << ' '
+         << CXI->getAlign().value() << ' '
+         << unsigned(CXI->getSuccessOrdering()) << ' '
+         << unsigned(CXI->getFailureOrdering());
+    HashSyncScope(CXI->getSyncScopeID());
+  } else if (const auto *RMWI = dyn_cast<AtomicRMWInst>(&I)) {
+    Hash << RMWI->getOperation() << ' ' << RMWI->isVolatile() << ' '
+         << RMWI->getAlign().value() << ' ' << unsigned(RMWI->getOrdering());
+    HashSyncScope(RMWI->getSyncScopeID());
+  } else if (const auto *GEP = dyn_cast<GetElementPtrInst>(&I)) {
+    TypePrinter.print(GEP->getSourceElementType(), Hash);
+  } else if (const auto *SVI = dyn_cast<ShuffleVectorInst>(&I)) {
+    for (int Elt : SVI->getShuffleMask())
+      Hash << Elt << ' ';
+  } else if (const auto *EVI = dyn_cast<ExtractValueInst>(&I)) {
+    for (unsigned Idx : EVI->indices())
+      Hash << Idx << ' ';
+  } else if (const auto *IVI = dyn_cast<InsertValueInst>(&I)) {
+    for (unsigned Idx : IVI->indices())
+      Hash << Idx << ' ';
+  } else if (const auto *PN = dyn_cast<PHINode>(&I)) {
+    for (const BasicBlock *BB : PN->blocks())
+      hashOperand(Hash, BB);
+  } else if (const auto *LPI = dyn_cast<LandingPadInst>(&I)) {
+    Hash << LPI->isCleanup();
+    for (unsigned C = 0, E = LPI->getNumClauses(); C != E; ++C)
+      Hash << ' ' << LPI->isCatch(C);
+  } else if (const auto *Call = dyn_cast<CallBase>(&I)) {
+    Hash << Call->getCallingConv() << ' ';
+    if (const auto *CI = dyn_cast<CallInst>(Call))
+      Hash << CI->getTailCallKind() << ' ';
+    TypePrinter.print(Call->getFunctionType(), Hash);
+    const AttributeList &PAL = Call->getAttributes();
+    if (PAL.hasRetAttrs())
+      Hash << ' ' << getAttributeSetString(PAL.getRetAttrs(), ASK_Return);
+    for (unsigned Op = 0, E = Call->arg_size(); Op != E; ++Op) {
+      AttributeSet ArgAttrs = PAL.getParamAttrs(Op);
+      if (ArgAttrs.hasAttributes())
+        Hash << ' ' << Op << ' ' << getAttributeSetString(ArgAttrs, ASK_Plain);
+    }
+    if (PAL.hasFnAttrs())
+      Hash << " #" << Machine.getAttributeGroupSlot(PAL.getFnAttrs());
+    for (unsigned B = 0, E = Call->getNumOperandBundles(); B != E; ++B) {
+      OperandBundleUse Bundle = Call->getOperandBundleAt(B);
+      Hash << ' ' << Bundle.getTagName() << ' ' << Bundle.Inputs.size();
+    }
+  }
+  Hash << '\n';
+
+  SmallVector<std::pair<unsigned, MDNode *>, 4> InstMD;
+  I.getAllMetadata(InstMD);
+  hashMetadataAttachments(Hash, InstMD);
+}
+
 /// printArgument - This member is called for every argument that is passed into
 /// the function.  Simply print it out
 void HTMLAssemblyWriter::printArgument(const Argument *Arg, AttributeSet Attrs) {
@@ -4386,11 +6345,26 @@ void HTMLAssemblyWriter::printBasicBlock(const BasicBlock *BB) {
       Out << " No predecessors!";
     } else {
       Out << " preds = ";
+      unsigned MaxPrinted =
+          Options.MaxPredecessors ? Options.MaxPredecessors : ~0U;
       writeOperand(*PI, false);
-      for (++PI; PI != PE; ++PI) {
+      for (unsigned N = 1; ++PI != PE && N != MaxPrinted; ++N) {
         Out << ", ";
         writeOperand(*PI, false);
       }
+      if (PI != PE) {
+        Out << ", ";
+        printFolded(getHTMLId(getHTMLTag(BB)) + ".preds",
+                    "... " + Twine(std::distance(PI, PE)) +
+                        " more predecessors",
+                    [&] {
+                      writeOperand(*PI, false);
+                      for (++PI; PI != PE; ++PI) {
+                        Out << ", ";
+                        writeOperand(*PI, false);
+                      }
+                    });
+      }
     }
   }
 
@@ -4399,8 +6373,20 @@ void HTMLAssemblyWriter::printBasicBlock(const BasicBlock *BB) {
   if (AnnotationWriter) AnnotationWriter->emitBasicBlockStartAnnot(BB, Out);
 
   // Output all of the instructions in the basic block...
-  for (const Instruction &I : *BB) {
-    printInstructionLine(I);
+  unsigned MaxPrinted =
+      Options.MaxBlockInstructions ? Options.MaxBlockInstructions : ~0U;
+  auto I = BB->begin(), E = BB->end();
+  for (unsigned N = 0; I != E && N != MaxPrinted; ++I, ++N)
+    printInstructionLine(*I);
+  if (I != E) {
+    Out << "  ";
+    printFolded(getHTMLId(getHTMLTag(BB)),
+                "... " + Twine(std::distance(I, E)) + " more instructions",
+                [&] {
+                  for (; I != E; ++I)
+                    printInstructionLine(*I);
+                });
+    Out << '\n';
   }
 
   if (AnnotationWriter) AnnotationWriter->emitBasicBlockEndAnnot(BB, Out);
@@ -4453,6 +6439,22 @@ static void maybePrintCallAddrSpace(const Value *Operand, const Instruction *I,
     Out << " addrspace(" << CallAddrSpace << ")";
 }
 
+/// getOpcodeNameFragment - Return the mnemonic for \p Opcode. The names are
+/// computed once into a table indexed by opcode so that the per-instruction
+/// path neither walks Instruction::getOpcodeName's switch nor re-measures the
+/// C string.
+static StringRef getOpcodeNameFragment(unsigned Opcode) {
+  static const std::array<StringRef, Instruction::OtherOpsEnd> Names = [] {
+    std::array<StringRef, Instruction::OtherOpsEnd> Table;
+    for (unsigned Op = 1; Op != Instruction::OtherOpsEnd; ++Op)
+      Table[Op] = Instruction::getOpcodeName(Op);
+    return Table;
+  }();
+  if (Opcode < Names.size())
+    return Names[Opcode];
+  return Instruction::getOpcodeName(Opcode);
+}
+
 // This member is called for each Instruction in a function..
 void HTMLAssemblyWriter::printInstruction(const Instruction &I) {
   if (AnnotationWriter) AnnotationWriter->emitInstructionAnnot(&I, Out);
@@ -4475,420 +6477,619 @@ void HTMLAssemblyWriter::printInstruction(const Instruction &I) {
     }
   }
 
-  if (const CallInst *CI = dyn_cast<CallInst>(&I)) {
-    if (CI->isMustTailCall())
+  unsigned Opcode = I.getOpcode();
+  if (Opcode == Instruction::Call) {
+    const CallInst &CI = cast<CallInst>(I);
+    if (CI.isMustTailCall())
       Out << "musttail ";
-    else if (CI->isTailCall())
+    else if (CI.isTailCall())
       Out << "tail ";
-    else if (CI->isNoTailCall())
+    else if (CI.isNoTailCall())
       Out << "notail ";
   }
 
   // Print out the opcode...
-  Out << I.getOpcodeName();
+  Out << getOpcodeNameFragment(Opcode);
 
-  // If this is an atomic load or store, print out the atomic marker.
-  if ((isa<LoadInst>(I)  && cast<LoadInst>(I).isAtomic()) ||
-      (isa<StoreInst>(I) && cast<StoreInst>(I).isAtomic()))
-    Out << " atomic";
-
-  if (isa<AtomicCmpXchgInst>(I) && cast<AtomicCmpXchgInst>(I).isWeak())
-    Out << " weak";
+  // Everything after the opcode is specific to the instruction kind; dispatch
+  // on the opcode once instead of probing each instruction class in turn.
+  switch (Opcode) {
+  case Instruction::Ret:
+    printReturnInst(cast<ReturnInst>(I));
+    break;
+  case Instruction::Br:
+    printBranchInst(cast<BranchInst>(I));
+    break;
+  case Instruction::Switch:
+    printSwitchInst(cast<SwitchInst>(I));
+    break;
+  case Instruction::IndirectBr:
+    printIndirectBrInst(cast<IndirectBrInst>(I));
+    break;
+  case Instruction::Invoke:
+    printInvokeInst(cast<InvokeInst>(I));
+    break;
+  case Instruction::CallBr:
+    printCallBrInst(cast<CallBrInst>(I));
+    break;
+  case Instruction::Call:
+    printCallInst(cast<CallInst>(I));
+    break;
+  case Instruction::CatchSwitch:
+    printCatchSwitchInst(cast<CatchSwitchInst>(I));
+    break;
+  case Instruction::CatchPad:
+  case Instruction::CleanupPad:
+    printFuncletPadInst(cast<FuncletPadInst>(I));
+    break;
+  case Instruction::CatchRet:
+    printCatchReturnInst(cast<CatchReturnInst>(I));
+    break;
+  case Instruction::CleanupRet:
+    printCleanupReturnInst(cast<CleanupReturnInst>(I));
+    break;
+  case Instruction::PHI:
+    printPHINode(cast<PHINode>(I));
+    break;
+  case Instruction::LandingPad:
+    printLandingPadInst(cast<LandingPadInst>(I));
+    break;
+  case Instruction::ExtractValue:
+    printExtractValueInst(cast<ExtractValueInst>(I));
+    break;
+  case Instruction::InsertValue:
+    printInsertValueInst(cast<InsertValueInst>(I));
+    break;
+  case Instruction::Alloca:
+    printAllocaInst(cast<AllocaInst>(I));
+    break;
+  case Instruction::Load:
+    printLoadInst(cast<LoadInst>(I));
+    break;
+  case Instruction::Store:
+    printStoreInst(cast<StoreInst>(I));
+    break;
+  case Instruction::Fence:
+    printFenceInst(cast<FenceInst>(I));
+    break;
+  case Instruction::AtomicCmpXchg:
+    printAtomicCmpXchgInst(cast<AtomicCmpXchgInst>(I));
+    break;
+  case Instruction::AtomicRMW:
+    printAtomicRMWInst(cast<AtomicRMWInst>(I));
+    break;
+  case Instruction::ICmp:
+  case Instruction::FCmp:
+    printCmpInst(cast<CmpInst>(I));
+    break;
+  case Instruction::VAArg:
+    printVAArgInst(cast<VAArgInst>(I));
+    break;
+  case Instruction::ShuffleVector:
+    printShuffleVectorInst(cast<ShuffleVectorInst>(I));
+    break;
+  case Instruction::GetElementPtr:
+    printGetElementPtrInst(cast<GetElementPtrInst>(I));
+    break;
+  case Instruction::Select:
+    WriteOptimizationInfo(Out, &I);
+    printOperandList(I, /*PrintAllTypes=*/true);
+    break;
+#define HANDLE_CAST_INST(N, OPC, CLASS) case Instruction::OPC:
+#include "llvm/IR/Instruction.def"
+    printCastInst(cast<CastInst>(I));
+    break;
+  default:
+    // Unary and binary operators and everything else that prints its
+    // operands the normal way.
+    WriteOptimizationInfo(Out, &I);
+    printOperandList(I);
+    break;
+  }
 
-  // If this is a volatile operation, print out the volatile marker.
-  if ((isa<LoadInst>(I)  && cast<LoadInst>(I).isVolatile()) ||
-      (isa<StoreInst>(I) && cast<StoreInst>(I).isVolatile()) ||
-      (isa<AtomicCmpXchgInst>(I) && cast<AtomicCmpXchgInst>(I).isVolatile()) ||
-      (isa<AtomicRMWInst>(I) && cast<AtomicRMWInst>(I).isVolatile()))
-    Out << " volatile";
+  // Print Metadata info.
+  SmallVector<std::pair<unsigned, MDNode *>, 4> InstMD;
+  I.getAllMetadata(InstMD);
+  printMetadataAttachments(InstMD, ", ");
 
-  // Print out optimization information.
-  WriteOptimizationInfo(Out, &I);
+  // Print a nice comment.
+  printInfoComment(I);
+}
 
-  // Print out the compare instruction predicates
-  if (const CmpInst *CI = dyn_cast<CmpInst>(&I))
-    Out << ' ' << CI->getPredicate();
+/// printOperandList - Print the operands of \p I the normal way. Instructions
+/// whose operands all have the same type omit the type from all but the first
+/// operand, unless \p PrintAllTypes is set.
+void HTMLAssemblyWriter::printOperandList(const Instruction &I,
+                                          bool PrintAllTypes) {
+  if (!I.getNumOperands())
+    return;
 
-  // Print out the atomicrmw operation
-  if (const AtomicRMWInst *RMWI = dyn_cast<AtomicRMWInst>(&I))
-    Out << ' ' << AtomicRMWInst::getOperationName(RMWI->getOperation());
+  // Work with broken code.
+  const Value *Operand = I.getOperand(0);
+  if (!Operand)
+    return;
 
-  // Print out the type of the operands...
-  const Value *Operand = I.getNumOperands() ? I.getOperand(0) : nullptr;
+  Type *TheType = Operand->getType();
+  if (!PrintAllTypes) {
+    for (unsigned i = 1, E = I.getNumOperands(); i != E; ++i) {
+      Operand = I.getOperand(i);
+      // note that Operand shouldn't be null, but the test helps make dump()
+      // more tolerant of malformed IR
+      if (Operand && Operand->getType() != TheType) {
+        PrintAllTypes = true;    // We have differing types!  Print them all!
+        break;
+      }
+    }
+  }
 
-  // Special case conditional branches to swizzle the condition out to the front
-  if (isa<BranchInst>(I) && cast<BranchInst>(I).isConditional()) {
-    const BranchInst &BI(cast<BranchInst>(I));
+  if (!PrintAllTypes) {
     Out << ' ';
-    writeOperand(BI.getCondition(), true);
-    Out << ", ";
-    writeOperand(BI.getSuccessor(0), true);
-    Out << ", ";
-    writeOperand(BI.getSuccessor(1), true);
+    TypePrinter.print(TheType, Out);
+  }
 
-  } else if (isa<SwitchInst>(I)) {
-    const SwitchInst& SI(cast<SwitchInst>(I));
-    // Special case switch instruction to get formatting nice and correct.
-    Out << ' ';
-    writeOperand(SI.getCondition(), true);
-    Out << ", ";
-    writeOperand(SI.getDefaultDest(), true);
-    Out << " [";
-    for (auto Case : SI.cases()) {
+  Out << ' ';
+  for (unsigned i = 0, E = I.getNumOperands(); i != E; ++i) {
+    if (i) Out << ", ";
+    writeOperand(I.getOperand(i), PrintAllTypes);
+  }
+}
+
+void HTMLAssemblyWriter::printReturnInst(const ReturnInst &RI) {
+  if (!RI.getNumOperands() || !RI.getOperand(0)) {
+    Out << " void";
+    return;
+  }
+  printOperandList(RI, /*PrintAllTypes=*/true);
+}
+
+void HTMLAssemblyWriter::printBranchInst(const BranchInst &BI) {
+  if (!BI.isConditional()) {
+    printOperandList(BI);
+    return;
+  }
+
+  // Special case conditional branches to swizzle the condition out to the
+  // front.
+  Out << ' ';
+  writeOperand(BI.getCondition(), true);
+  Out << ", ";
+  writeOperand(BI.getSuccessor(0), true);
+  Out << ", ";
+  writeOperand(BI.getSuccessor(1), true);
+}
+
+void HTMLAssemblyWriter::printSwitchInst(const SwitchInst &SI) {
+  // Special case switch instruction to get formatting nice and correct.
+  Out << ' ';
+  writeOperand(SI.getCondition(), true);
+  Out << ", ";
+  writeOperand(SI.getDefaultDest(), true);
+  Out << " [";
+  auto PrintCases = [&](unsigned Begin, unsigned End) {
+    for (auto Case :
+         make_range(SI.case_begin() + Begin, SI.case_begin() + End)) {
       Out << "\n    ";
       writeOperand(Case.getCaseValue(), true);
       Out << ", ";
       writeOperand(Case.getCaseSuccessor(), true);
     }
-    Out << "\n  ]";
-  } else if (isa<IndirectBrInst>(I)) {
-    // Special case indirectbr instruction to get formatting nice and correct.
-    Out << ' ';
-    writeOperand(Operand, true);
-    Out << ", [";
+  };
+  unsigned NumCases = SI.getNumCases();
+  unsigned NumPrinted = getUnfoldedCount(NumCases, Options.MaxSwitchCases);
+  PrintCases(0, NumPrinted);
+  if (NumPrinted != NumCases) {
+    Out << "\n    ";
+    printFolded(getHTMLId(getHTMLTag(&SI)),
+                "... " + Twine(NumCases - NumPrinted) + " more cases",
+                [&] { PrintCases(NumPrinted, NumCases); });
+  }
+  Out << "\n  ]";
+}
 
-    for (unsigned i = 1, e = I.getNumOperands(); i != e; ++i) {
-      if (i != 1)
-        Out << ", ";
-      writeOperand(I.getOperand(i), true);
-    }
-    Out << ']';
-  } else if (const PHINode *PN = dyn_cast<PHINode>(&I)) {
-    Out << ' ';
-    TypePrinter.print(I.getType(), Out);
-    Out << ' ';
+void HTMLAssemblyWriter::printIndirectBrInst(const IndirectBrInst &IBI) {
+  // Special case indirectbr instruction to get formatting nice and correct.
+  Out << ' ';
+  writeOperand(IBI.getOperand(0), true);
+  Out << ", [";
+
+  for (unsigned i = 1, e = IBI.getNumOperands(); i != e; ++i) {
+    if (i != 1)
+      Out << ", ";
+    writeOperand(IBI.getOperand(i), true);
+  }
+  Out << ']';
+}
 
-    for (unsigned op = 0, Eop = PN->getNumIncomingValues(); op < Eop; ++op) {
-      if (op) Out << ", ";
+void HTMLAssemblyWriter::printPHINode(const PHINode &PN) {
+  WriteOptimizationInfo(Out, &PN);
+  Out << ' ';
+  TypePrinter.print(PN.getType(), Out);
+  Out << ' ';
+
+  auto PrintIncoming = [&](unsigned Begin, unsigned End) {
+    for (unsigned op = Begin; op < End; ++op) {
+      if (op != Begin) Out << ", ";
       Out << "[ ";
-      writeOperand(PN->getIncomingValue(op), false); Out << ", ";
-      writeOperand(PN->getIncomingBlock(op), false); Out << " ]";
+      writeOperand(PN.getIncomingValue(op), false); Out << ", ";
+      writeOperand(PN.getIncomingBlock(op), false); Out << " ]";
     }
-  } else if (const ExtractValueInst *EVI = dyn_cast<ExtractValueInst>(&I)) {
-    Out << ' ';
-    writeOperand(I.getOperand(0), true);
-    for (unsigned i : EVI->indices())
-      Out << ", " << i;
-  } else if (const InsertValueInst *IVI = dyn_cast<InsertValueInst>(&I)) {
-    Out << ' ';
-    writeOperand(I.getOperand(0), true); Out << ", ";
-    writeOperand(I.getOperand(1), true);
-    for (unsigned i : IVI->indices())
-      Out << ", " << i;
-  } else if (const LandingPadInst *LPI = dyn_cast<LandingPadInst>(&I)) {
-    Out << ' ';
-    TypePrinter.print(I.getType(), Out);
-    if (LPI->isCleanup() || LPI->getNumClauses() != 0)
-      Out << '\n';
+  };
+  unsigned NumIncoming = PN.getNumIncomingValues();
+  unsigned NumPrinted = getUnfoldedCount(NumIncoming, Options.MaxPhiIncoming);
+  PrintIncoming(0, NumPrinted);
+  if (NumPrinted != NumIncoming) {
+    Out << ", ";
+    printFolded(getHTMLId(getHTMLTag(&PN)),
+                "... " + Twine(NumIncoming - NumPrinted) +
+                    " more incoming values",
+                [&] { PrintIncoming(NumPrinted, NumIncoming); });
+  }
+}
 
-    if (LPI->isCleanup())
-      Out << "          cleanup";
+void HTMLAssemblyWriter::printExtractValueInst(const ExtractValueInst &EVI) {
+  Out << ' ';
+  writeOperand(EVI.getOperand(0), true);
+  for (unsigned i : EVI.indices())
+    Out << ", " << i;
+}
 
-    for (unsigned i = 0, e = LPI->getNumClauses(); i != e; ++i) {
-      if (i != 0 || LPI->isCleanup()) Out << "\n";
-      if (LPI->isCatch(i))
-        Out << "          catch ";
-      else
-        Out << "          filter ";
+void HTMLAssemblyWriter::printInsertValueInst(const InsertValueInst &IVI) {
+  Out << ' ';
+  writeOperand(IVI.getOperand(0), true); Out << ", ";
+  writeOperand(IVI.getOperand(1), true);
+  for (unsigned i : IVI.indices())
+    Out << ", " << i;
+}
 
-      writeOperand(LPI->getClause(i), true);
-    }
-  } else if (const auto *CatchSwitch = dyn_cast<CatchSwitchInst>(&I)) {
-    Out << " within ";
-    writeOperand(CatchSwitch->getParentPad(), /*PrintType=*/false);
-    Out << " [";
-    unsigned Op = 0;
-    for (const BasicBlock *PadBB : CatchSwitch->handlers()) {
-      if (Op > 0)
-        Out << ", ";
-      writeOperand(PadBB, /*PrintType=*/true);
-      ++Op;
-    }
-    Out << "] unwind ";
-    if (const BasicBlock *UnwindDest = CatchSwitch->getUnwindDest())
-      writeOperand(UnwindDest, /*PrintType=*/true);
-    else
-      Out << "to caller";
-  } else if (const auto *FPI = dyn_cast<FuncletPadInst>(&I)) {
-    Out << " within ";
-    writeOperand(FPI->getParentPad(), /*PrintType=*/false);
-    Out << " [";
-    for (unsigned Op = 0, NumOps = FPI->arg_size(); Op < NumOps; ++Op) {
-      if (Op > 0)
-        Out << ", ";
-      writeOperand(FPI->getArgOperand(Op), /*PrintType=*/true);
-    }
-    Out << ']';
-  } else if (isa<ReturnInst>(I) && !Operand) {
-    Out << " void";
-  } else if (const auto *CRI = dyn_cast<CatchReturnInst>(&I)) {
-    Out << " from ";
-    writeOperand(CRI->getOperand(0), /*PrintType=*/false);
-
-    Out << " to ";
-    writeOperand(CRI->getOperand(1), /*PrintType=*/true);
-  } else if (const auto *CRI = dyn_cast<CleanupReturnInst>(&I)) {
-    Out << " from ";
-    writeOperand(CRI->getOperand(0), /*PrintType=*/false);
-
-    Out << " unwind ";
-    if (CRI->hasUnwindDest())
-      writeOperand(CRI->getOperand(1), /*PrintType=*/true);
+void HTMLAssemblyWriter::printLandingPadInst(const LandingPadInst &LPI) {
+  Out << ' ';
+  TypePrinter.print(LPI.getType(), Out);
+  if (LPI.isCleanup() || LPI.getNumClauses() != 0)
+    Out << '\n';
+
+  if (LPI.isCleanup())
+    Out << "          cleanup";
+
+  for (unsigned i = 0, e = LPI.getNumClauses(); i != e; ++i) {
+    if (i != 0 || LPI.isCleanup()) Out << "\n";
+    if (LPI.isCatch(i))
+      Out << "          catch ";
     else
-      Out << "to caller";
-  } else if (const CallInst *CI = dyn_cast<CallInst>(&I)) {
-    // Print the calling convention being used.
-    if (CI->getCallingConv() != CallingConv::C) {
-      Out << " ";
-      PrintCallingConv(CI->getCallingConv(), Out);
-    }
+      Out << "          filter ";
 
-    Operand = CI->getCalledOperand();
-    FunctionType *FTy = CI->getFunctionType();
-    Type *RetTy = FTy->getReturnType();
-    const AttributeList &PAL = CI->getAttributes();
+    writeOperand(LPI.getClause(i), true);
+  }
+}
 
-    if (PAL.hasRetAttrs())
-      Out << ' ' << PAL.getAsString(AttributeList::ReturnIndex);
+void HTMLAssemblyWriter::printCatchSwitchInst(const CatchSwitchInst &CSI) {
+  Out << " within ";
+  writeOperand(CSI.getParentPad(), /*PrintType=*/false);
+  Out << " [";
+  unsigned Op = 0;
+  for (const BasicBlock *PadBB : CSI.handlers()) {
+    if (Op > 0)
+      Out << ", ";
+    writeOperand(PadBB, /*PrintType=*/true);
+    ++Op;
+  }
+  Out << "] unwind ";
+  if (const BasicBlock *UnwindDest = CSI.getUnwindDest())
+    writeOperand(UnwindDest, /*PrintType=*/true);
+  else
+    Out << "to caller";
+}
 
-    // Only print addrspace(N) if necessary:
-    maybePrintCallAddrSpace(Operand, &I, Out);
+void HTMLAssemblyWriter::printFuncletPadInst(const FuncletPadInst &FPI) {
+  Out << " within ";
+  writeOperand(FPI.getParentPad(), /*PrintType=*/false);
+  Out << " [";
+  for (unsigned Op = 0, NumOps = FPI.arg_size(); Op < NumOps; ++Op) {
+    if (Op > 0)
+      Out << ", ";
+    writeOperand(FPI.getArgOperand(Op), /*PrintType=*/true);
+  }
+  Out << ']';
+}
 
-    // If possible, print out the short form of the call instruction.  We can
-    // only do this if the first argument is a pointer to a nonvararg function,
-    // and if the return type is not a pointer to a function.
-    Out << ' ';
-    TypePrinter.print(FTy->isVarArg() ? FTy : RetTy, Out);
-    Out << ' ';
-    writeOperand(Operand, false);
-    Out << '(';
-    for (unsigned op = 0, Eop = CI->arg_size(); op < Eop; ++op) {
-      if (op > 0)
-        Out << ", ";
-      writeParamOperand(CI->getArgOperand(op), PAL.getParamAttrs(op));
-    }
+void HTMLAssemblyWriter::printCatchReturnInst(const CatchReturnInst &CRI) {
+  Out << " from ";
+  writeOperand(CRI.getOperand(0), /*PrintType=*/false);
 
-    // Emit an ellipsis if this is a musttail call in a vararg function.  This
-    // is only to aid readability, musttail calls forward varargs by default.
-    if (CI->isMustTailCall() && CI->getParent() &&
-        CI->getParent()->getParent() &&
-        CI->getParent()->getParent()->isVarArg()) {
-      if (CI->arg_size() > 0)
-        Out << ", ";
-      Out << "...";
-    }
+  Out << " to ";
+  writeOperand(CRI.getOperand(1), /*PrintType=*/true);
+}
 
-    Out << ')';
-    if (PAL.hasFnAttrs())
-      Out << " #" << Machine.getAttributeGroupSlot(PAL.getFnAttrs());
-
-    writeOperandBundles(CI);
-  } else if (const InvokeInst *II = dyn_cast<InvokeInst>(&I)) {
-    Operand = II->getCalledOperand();
-    FunctionType *FTy = II->getFunctionType();
-    Type *RetTy = FTy->getReturnType();
-    const AttributeList &PAL = II->getAttributes();
-
-    // Print the calling convention being used.
-    if (II->getCallingConv() != CallingConv::C) {
-      Out << " ";
-      PrintCallingConv(II->getCallingConv(), Out);
-    }
+void HTMLAssemblyWriter::printCleanupReturnInst(const CleanupReturnInst &CRI) {
+  Out << " from ";
+  writeOperand(CRI.getOperand(0), /*PrintType=*/false);
 
-    if (PAL.hasRetAttrs())
-      Out << ' ' << PAL.getAsString(AttributeList::ReturnIndex);
+  Out << " unwind ";
+  if (CRI.hasUnwindDest())
+    writeOperand(CRI.getOperand(1), /*PrintType=*/true);
+  else
+    Out << "to caller";
+}
 
-    // Only print addrspace(N) if necessary:
-    maybePrintCallAddrSpace(Operand, &I, Out);
+void HTMLAssemblyWriter::printCallInst(const CallInst &CI) {
+  WriteOptimizationInfo(Out, &CI);
 
-    // If possible, print out the short form of the invoke instruction. We can
-    // only do this if the first argument is a pointer to a nonvararg function,
-    // and if the return type is not a pointer to a function.
-    //
-    Out << ' ';
-    TypePrinter.print(FTy->isVarArg() ? FTy : RetTy, Out);
-    Out << ' ';
-    writeOperand(Operand, false);
-    Out << '(';
-    for (unsigned op = 0, Eop = II->arg_size(); op < Eop; ++op) {
-      if (op)
-        Out << ", ";
-      writeParamOperand(II->getArgOperand(op), PAL.getParamAttrs(op));
-    }
+  // Print the calling convention being used.
+  if (CI.getCallingConv() != CallingConv::C) {
+    Out << " ";
+    PrintCallingConv(CI.getCallingConv(), Out);
+  }
 
-    Out << ')';
-    if (PAL.hasFnAttrs())
-      Out << " #" << Machine.getAttributeGroupSlot(PAL.getFnAttrs());
-
-    writeOperandBundles(II);
-
-    Out << "\n          to ";
-    writeOperand(II->getNormalDest(), true);
-    Out << " unwind ";
-    writeOperand(II->getUnwindDest(), true);
-  } else if (const CallBrInst *CBI = dyn_cast<CallBrInst>(&I)) {
-    Operand = CBI->getCalledOperand();
-    FunctionType *FTy = CBI->getFunctionType();
-    Type *RetTy = FTy->getReturnType();
-    const AttributeList &PAL = CBI->getAttributes();
-
-    // Print the calling convention being used.
-    if (CBI->getCallingConv() != CallingConv::C) {
-      Out << " ";
-      PrintCallingConv(CBI->getCallingConv(), Out);
-    }
+  const Value *Operand = CI.getCalledOperand();
+  FunctionType *FTy = CI.getFunctionType();
+  Type *RetTy = FTy->getReturnType();
+  const AttributeList &PAL = CI.getAttributes();
 
-    if (PAL.hasRetAttrs())
-      Out << ' ' << PAL.getAsString(AttributeList::ReturnIndex);
+  if (PAL.hasRetAttrs())
+    Out << ' ' << getAttributeSetString(PAL.getRetAttrs(), ASK_Return);
 
-    // If possible, print out the short form of the callbr instruction. We can
-    // only do this if the first argument is a pointer to a nonvararg function,
-    // and if the return type is not a pointer to a function.
-    //
-    Out << ' ';
-    TypePrinter.print(FTy->isVarArg() ? FTy : RetTy, Out);
-    Out << ' ';
-    writeOperand(Operand, false);
-    Out << '(';
-    for (unsigned op = 0, Eop = CBI->arg_size(); op < Eop; ++op) {
-      if (op)
-        Out << ", ";
-      writeParamOperand(CBI->getArgOperand(op), PAL.getParamAttrs(op));
-    }
+  // Only print addrspace(N) if necessary:
+  maybePrintCallAddrSpace(Operand, &CI, Out);
 
-    Out << ')';
-    if (PAL.hasFnAttrs())
-      Out << " #" << Machine.getAttributeGroupSlot(PAL.getFnAttrs());
+  // If possible, print out the short form of the call instruction.  We can
+  // only do this if the first argument is a pointer to a nonvararg function,
+  // and if the return type is not a pointer to a function.
+  Out << ' ';
+  TypePrinter.print(FTy->isVarArg() ? FTy : RetTy, Out);
+  Out << ' ';
+  writeOperand(Operand, false);
+  Out << '(';
+  for (unsigned op = 0, Eop = CI.arg_size(); op < Eop; ++op) {
+    if (op > 0)
+      Out << ", ";
+    writeParamOperand(CI.getArgOperand(op), PAL.getParamAttrs(op));
+  }
 
-    writeOperandBundles(CBI);
+  // Emit an ellipsis if this is a musttail call in a vararg function.  This
+  // is only to aid readability, musttail calls forward varargs by default.
+  if (CI.isMustTailCall() && CI.getParent() &&
+      CI.getParent()->getParent() &&
+      CI.getParent()->getParent()->isVarArg()) {
+    if (CI.arg_size() > 0)
+      Out << ", ";
+    Out << "...";
+  }
 
-    Out << "\n          to ";
-    writeOperand(CBI->getDefaultDest(), true);
-    Out << " [";
-    for (unsigned i = 0, e = CBI->getNumIndirectDests(); i != e; ++i) {
-      if (i != 0)
-        Out << ", ";
-      writeOperand(CBI->getIndirectDest(i), true);
-    }
-    Out << ']';
-  } else if (const AllocaInst *AI = dyn_cast<AllocaInst>(&I)) {
-    Out << ' ';
-    if (AI->isUsedWithInAlloca())
-      Out << "inalloca ";
-    if (AI->isSwiftError())
-      Out << "swifterror ";
-    TypePrinter.print(AI->getAllocatedType(), Out);
-
-    // Explicitly write the array size if the code is broken, if it's an array
-    // allocation, or if the type is not canonical for scalar allocations.  The
-    // latter case prevents the type from mutating when round-tripping through
-    // assembly.
-    if (!AI->getArraySize() || AI->isArrayAllocation() ||
-        !AI->getArraySize()->getType()->isIntegerTy(32)) {
+  Out << ')';
+  if (PAL.hasFnAttrs())
+    writeAttributeGroupRef(PAL.getFnAttrs());
+
+  writeOperandBundles(&CI);
+}
+
+void HTMLAssemblyWriter::printInvokeInst(const InvokeInst &II) {
+  const Value *Operand = II.getCalledOperand();
+  FunctionType *FTy = II.getFunctionType();
+  Type *RetTy = FTy->getReturnType();
+  const AttributeList &PAL = II.getAttributes();
+
+  // Print the calling convention being used.
+  if (II.getCallingConv() != CallingConv::C) {
+    Out << " ";
+    PrintCallingConv(II.getCallingConv(), Out);
+  }
+
+  if (PAL.hasRetAttrs())
+    Out << ' ' << getAttributeSetString(PAL.getRetAttrs(), ASK_Return);
+
+  // Only print addrspace(N) if necessary:
+  maybePrintCallAddrSpace(Operand, &II, Out);
+
+  // If possible, print out the short form of the invoke instruction. We can
+  // only do this if the first argument is a pointer to a nonvararg function,
+  // and if the return type is not a pointer to a function.
+  //
+  Out << ' ';
+  TypePrinter.print(FTy->isVarArg() ? FTy : RetTy, Out);
+  Out << ' ';
+  writeOperand(Operand, false);
+  Out << '(';
+  for (unsigned op = 0, Eop = II.arg_size(); op < Eop; ++op) {
+    if (op)
       Out << ", ";
-      writeOperand(AI->getArraySize(), true);
-    }
-    if (MaybeAlign A = AI->getAlign()) {
-      Out << ", align " << A->value();
-    }
+    writeParamOperand(II.getArgOperand(op), PAL.getParamAttrs(op));
+  }
 
-    unsigned AddrSpace = AI->getAddressSpace();
-    if (AddrSpace != 0) {
-      Out << ", addrspace(" << AddrSpace << ')';
-    }
-  } else if (isa<CastInst>(I)) {
-    if (Operand) {
-      Out << ' ';
-      writeOperand(Operand, true);   // Work with broken code
-    }
-    Out << " to ";
-    TypePrinter.print(I.getType(), Out);
-  } else if (isa<VAArgInst>(I)) {
-    if (Operand) {
-      Out << ' ';
-      writeOperand(Operand, true);   // Work with broken code
-    }
+  Out << ')';
+  if (PAL.hasFnAttrs())
+    writeAttributeGroupRef(PAL.getFnAttrs());
+
+  writeOperandBundles(&II);
+
+  Out << "\n          to ";
+  writeOperand(II.getNormalDest(), true);
+  Out << " unwind ";
+  writeOperand(II.getUnwindDest(), true);
+}
+
+void HTMLAssemblyWriter::printCallBrInst(const CallBrInst &CBI) {
+  const Value *Operand = CBI.getCalledOperand();
+  FunctionType *FTy = CBI.getFunctionType();
+  Type *RetTy = FTy->getReturnType();
+  const AttributeList &PAL = CBI.getAttributes();
+
+  // Print the calling convention being used.
+  if (CBI.getCallingConv() != CallingConv::C) {
+    Out << " ";
+    PrintCallingConv(CBI.getCallingConv(), Out);
+  }
+
+  if (PAL.hasRetAttrs())
+    Out << ' ' << getAttributeSetString(PAL.getRetAttrs(), ASK_Return);
+
+  // If possible, print out the short form of the callbr instruction. We can
+  // only do this if the first argument is a pointer to a nonvararg function,
+  // and if the return type is not a pointer to a function.
+  //
+  Out << ' ';
+  TypePrinter.print(FTy->isVarArg() ? FTy : RetTy, Out);
+  Out << ' ';
+  writeOperand(Operand, false);
+  Out << '(';
+  for (unsigned op = 0, Eop = CBI.arg_size(); op < Eop; ++op) {
+    if (op)
+      Out << ", ";
+    writeParamOperand(CBI.getArgOperand(op), PAL.getParamAttrs(op));
+  }
+
+  Out << ')';
+  if (PAL.hasFnAttrs())
+    writeAttributeGroupRef(PAL.getFnAttrs());
+
+  writeOperandBundles(&CBI);
+
+  Out << "\n          to ";
+  writeOperand(CBI.getDefaultDest(), true);
+  Out << " [";
+  for (unsigned i = 0, e = CBI.getNumIndirectDests(); i != e; ++i) {
+    if (i != 0)
+      Out << ", ";
+    writeOperand(CBI.getIndirectDest(i), true);
+  }
+  Out << ']';
+}
+
+void HTMLAssemblyWriter::printAllocaInst(const AllocaInst &AI) {
+  Out << ' ';
+  if (AI.isUsedWithInAlloca())
+    Out << "inalloca ";
+  if (AI.isSwiftError())
+    Out << "swifterror ";
+  TypePrinter.print(AI.getAllocatedType(), Out);
+
+  // Explicitly write the array size if the code is broken, if it's an array
+  // allocation, or if the type is not canonical for scalar allocations.  The
+  // latter case prevents the type from mutating when round-tripping through
+  // assembly.
+  if (!AI.getArraySize() || AI.isArrayAllocation() ||
+      !AI.getArraySize()->getType()->isIntegerTy(32)) {
     Out << ", ";
-    TypePrinter.print(I.getType(), Out);
-  } else if (Operand) {   // Print the normal way.
-    if (const auto *GEP = dyn_cast<GetElementPtrInst>(&I)) {
-      Out << ' ';
-      TypePrinter.print(GEP->getSourceElementType(), Out);
-      Out << ',';
-    } else if (const auto *LI = dyn_cast<LoadInst>(&I)) {
-      Out << ' ';
-      TypePrinter.print(LI->getType(), Out);
-      Out << ',';
-    }
+    writeOperand(AI.getArraySize(), true);
+  }
+  if (MaybeAlign A = AI.getAlign()) {
+    Out << ", align " << A->value();
+  }
 
-    // PrintAllTypes - Instructions who have operands of all the same type
-    // omit the type from all but the first operand.  If the instruction has
-    // different type operands (for example br), then they are all printed.
-    bool PrintAllTypes = false;
-    Type *TheType = Operand->getType();
-
-    // Select, Store, ShuffleVector, CmpXchg and AtomicRMW always print all
-    // types.
-    if (isa<SelectInst>(I) || isa<StoreInst>(I) || isa<ShuffleVectorInst>(I) ||
-        isa<ReturnInst>(I) || isa<AtomicCmpXchgInst>(I) ||
-        isa<AtomicRMWInst>(I)) {
-      PrintAllTypes = true;
-    } else {
-      for (unsigned i = 1, E = I.getNumOperands(); i != E; ++i) {
-        Operand = I.getOperand(i);
-        // note that Operand shouldn't be null, but the test helps make dump()
-        // more tolerant of malformed IR
-        if (Operand && Operand->getType() != TheType) {
-          PrintAllTypes = true;    // We have differing types!  Print them all!
-          break;
-        }
-      }
-    }
+  unsigned AddrSpace = AI.getAddressSpace();
+  if (AddrSpace != 0) {
+    Out << ", addrspace(" << AddrSpace << ')';
+  }
+}
 
-    if (!PrintAllTypes) {
-      Out << ' ';
-      TypePrinter.print(TheType, Out);
-    }
+void HTMLAssemblyWriter::printCastInst(const CastInst &CI) {
+  WriteOptimizationInfo(Out, &CI);
+  if (const Value *Operand = CI.getNumOperands() ? CI.getOperand(0) : nullptr) {
+    Out << ' ';
+    writeOperand(Operand, true);   // Work with broken code
+  }
+  Out << " to ";
+  TypePrinter.print(CI.getType(), Out);
+}
 
+void HTMLAssemblyWriter::printVAArgInst(const VAArgInst &VAI) {
+  if (const Value *Operand = VAI.getNumOperands() ? VAI.getOperand(0) : nullptr) {
     Out << ' ';
-    for (unsigned i = 0, E = I.getNumOperands(); i != E; ++i) {
-      if (i) Out << ", ";
-      writeOperand(I.getOperand(i), PrintAllTypes);
-    }
+    writeOperand(Operand, true);   // Work with broken code
   }
+  Out << ", ";
+  TypePrinter.print(VAI.getType(), Out);
+}
 
-  // Print atomic ordering/alignment for memory operations
-  if (const LoadInst *LI = dyn_cast<LoadInst>(&I)) {
-    if (LI->isAtomic())
-      writeAtomic(LI->getContext(), LI->getOrdering(), LI->getSyncScopeID());
-    if (MaybeAlign A = LI->getAlign())
-      Out << ", align " << A->value();
-  } else if (const StoreInst *SI = dyn_cast<StoreInst>(&I)) {
-    if (SI->isAtomic())
-      writeAtomic(SI->getContext(), SI->getOrdering(), SI->getSyncScopeID());
-    if (MaybeAlign A = SI->getAlign())
-      Out << ", align " << A->value();
-  } else if (const AtomicCmpXchgInst *CXI = dyn_cast<AtomicCmpXchgInst>(&I)) {
-    writeAtomicCmpXchg(CXI->getContext(), CXI->getSuccessOrdering(),
-                       CXI->getFailureOrdering(), CXI->getSyncScopeID());
-    Out << ", align " << CXI->getAlign().value();
-  } else if (const AtomicRMWInst *RMWI = dyn_cast<AtomicRMWInst>(&I)) {
-    writeAtomic(RMWI->getContext(), RMWI->getOrdering(),
-                RMWI->getSyncScopeID());
-    Out << ", align " << RMWI->getAlign().value();
-  } else if (const FenceInst *FI = dyn_cast<FenceInst>(&I)) {
-    writeAtomic(FI->getContext(), FI->getOrdering(), FI->getSyncScopeID());
-  } else if (const ShuffleVectorInst *SVI = dyn_cast<ShuffleVectorInst>(&I)) {
-    PrintShuffleMask(Out, SVI->getType(), SVI->getShuffleMask());
+void HTMLAssemblyWriter::printLoadInst(const LoadInst &LI) {
+  // If this is an atomic or volatile load, print out the markers.
+  if (LI.isAtomic())
+    Out << " atomic";
+  if (LI.isVolatile())
+    Out << " volatile";
+
+  if (LI.getNumOperands() && LI.getOperand(0)) {
+    Out << ' ';
+    TypePrinter.print(LI.getType(), Out);
+    Out << ',';
+    printOperandList(LI);
   }
 
-  // Print Metadata info.
-  SmallVector<std::pair<unsigned, MDNode *>, 4> InstMD;
-  I.getAllMetadata(InstMD);
-  printMetadataAttachments(InstMD, ", ");
+  // Print atomic ordering/alignment for memory operations
+  if (LI.isAtomic())
+    writeAtomic(LI.getContext(), LI.getOrdering(), LI.getSyncScopeID());
+  if (MaybeAlign A = LI.getAlign())
+    Out << ", align " << A->value();
+}
 
-  // Print a nice comment.
-  printInfoComment(I);
+void HTMLAssemblyWriter::printStoreInst(const StoreInst &SI) {
+  // If this is an atomic or volatile store, print out the markers.
+  if (SI.isAtomic())
+    Out << " atomic";
+  if (SI.isVolatile())
+    Out << " volatile";
+
+  printOperandList(SI, /*PrintAllTypes=*/true);
+
+  // Print atomic ordering/alignment for memory operations
+  if (SI.isAtomic())
+    writeAtomic(SI.getContext(), SI.getOrdering(), SI.getSyncScopeID());
+  if (MaybeAlign A = SI.getAlign())
+    Out << ", align " << A->value();
+}
+
+void HTMLAssemblyWriter::printFenceInst(const FenceInst &FI) {
+  printOperandList(FI);
+  writeAtomic(FI.getContext(), FI.getOrdering(), FI.getSyncScopeID());
+}
+
+void HTMLAssemblyWriter::printAtomicCmpXchgInst(const AtomicCmpXchgInst &CXI) {
+  if (CXI.isWeak())
+    Out << " weak";
+  if (CXI.isVolatile())
+    Out << " volatile";
+
+  printOperandList(CXI, /*PrintAllTypes=*/true);
+
+  writeAtomicCmpXchg(CXI.getContext(), CXI.getSuccessOrdering(),
+                     CXI.getFailureOrdering(), CXI.getSyncScopeID());
+  Out << ", align " << CXI.getAlign().value();
+}
+
+void HTMLAssemblyWriter::printAtomicRMWInst(const AtomicRMWInst &RMWI) {
+  if (RMWI.isVolatile())
+    Out << " volatile";
+
+  // Print out the atomicrmw operation
+  Out << ' ' << AtomicRMWInst::getOperationName(RMWI.getOperation());
+
+  printOperandList(RMWI, /*PrintAllTypes=*/true);
+
+  writeAtomic(RMWI.getContext(), RMWI.getOrdering(), RMWI.getSyncScopeID());
+  Out << ", align " << RMWI.getAlign().value();
+}
+
+void HTMLAssemblyWriter::printCmpInst(const CmpInst &CI) {
+  WriteOptimizationInfo(Out, &CI);
+
+  // Print out the compare instruction predicates
+  Out << ' ' << CI.getPredicate();
+
+  printOperandList(CI);
+}
+
+void HTMLAssemblyWriter::printShuffleVectorInst(const ShuffleVectorInst &SVI) {
+  printOperandList(SVI, /*PrintAllTypes=*/true);
+  PrintShuffleMask(Out, SVI.getType(), SVI.getShuffleMask());
+}
+
+void HTMLAssemblyWriter::printGetElementPtrInst(const GetElementPtrInst &GEP) {
+  WriteOptimizationInfo(Out, &GEP);
+  if (!GEP.getNumOperands() || !GEP.getOperand(0))
+    return;
+
+  Out << ' ';
+  TypePrinter.print(GEP.getSourceElementType(), Out);
+  Out << ',';
+  printOperandList(GEP);
 }
 
 void HTMLAssemblyWriter::printMetadataAttachments(
@@ -4914,20 +7115,331 @@ void HTMLAssemblyWriter::printMetadataAttachments(
   }
 }
 
-void HTMLAssemblyWriter::writeMDNode(unsigned Slot, const MDNode *Node) {
-  Out << '!' << Slot << " = ";
-  printMDNodeBody(Node);
-  Out << "\n";
+/// Write the definition anchor of metadata slot \p Slot, on the page at
+/// \p PageURL.
+static void writeMDNodeDef(raw_ostream &OS, unsigned Slot,
+                           StringRef PageURL) {
+  writeDefOpen(OS, "md", Slot, PageURL);
+  OS << '!' << Slot << "</a> = ";
+}
+
+void HTMLAssemblyWriter::writeMDNode(raw_ostream &OS, unsigned Slot,
+                                     const MDNode *Node) {
+  auto WriterCtx = getContext();
+  writeMDNodeDef(OS, Slot, MetadataURL);
+  WriteMDNodeBodyInternal(OS, Node, WriterCtx);
+  OS << "\n";
+}
+
+void HTMLAssemblyWriter::writeMetadataShard(StringRef Title) {
+  std::unique_ptr<raw_fd_ostream> Shard = std::move(MetadataShard);
+  raw_fd_ostream &OS = *Shard;
+  OS << "<!DOCTYPE html>\n";
+  OS << "<html>\n";
+  OS << "<head>\n";
+  // Type references resolve against the page, where the types are defined.
+  OS << "<base href=\"";
+  printHTMLEscaped(OS, getPageURL());
+  OS << "\">\n";
+  OS << "<style>\n";
+  OS << "a:link, a:visited { color:black; text-decoration:none; }\n";
+  OS << ".def:target { background-color: #ffa; }\n";
+  OS << "</style>\n";
+  OS << "<title>";
+  printHTMLEscaped(OS, Title);
+  OS << " metadata</title>\n";
+  OS << "</head>\n";
+  OS << "<body>\n";
+  OS << "<pre>\n";
+
+  // References between nodes name the metadata page, MetadataURL, since
+  // relative links resolve against the page.
+  writeAllMDNodes(OS);
+
+  OS << "</pre>\n";
+  OS << "</body>\n";
+  OS << "</html>\n";
+  OS.close();
+  if (OS.has_error()) {
+    WithColor::warning() << MetadataURL << ": " << OS.error().message()
+                         << '\n';
+    OS.clear_error();
+  }
+  addSidecar(getMetadataShardPath());
+}
+
+/// collectFunctionStats - Count the instructions of each defined function of
+/// \p M for the function statistics page, in parallel. Their rendered sizes
+/// are filled in as they are printed.
+void HTMLAssemblyWriter::collectFunctionStats(const Module *M) {
+  if (Options.OutputPath.empty()) {
+    WithColor::warning()
+        << "function statistics are only written when writing to a file\n";
+    return;
+  }
+  StatsPageURL = getPageURL() + ".stats.html";
+
+  // Bodies that were not loaded have nothing to count.
+  for (const Function &F : *M)
+    if (!F.isDeclaration() && !F.isMaterializable())
+      FunctionStatsRows.emplace_back().F = &F;
+
+  TimeTraceScope TT("CollectFunctionStats");
+  parallelForEach(FunctionStatsRows, [](FunctionStats &S) {
+    for (const BasicBlock &BB : *S.F) {
+      unsigned BlockSize = 0;
+      for (const Instruction &I : BB) {
+        ++BlockSize;
+        if (isa<DbgInfoIntrinsic>(I))
+          ++S.DebugIntrinsics;
+        if (isa<CallBase>(I))
+          ++S.Calls;
+        else if (isa<LoadInst>(I))
+          ++S.Loads;
+        else if (isa<StoreInst>(I))
+          ++S.Stores;
+        else if (isa<AllocaInst>(I))
+          ++S.Allocas;
+        else if (isa<PHINode>(I))
+          ++S.PHIs;
+        if (I.getType()->isVectorTy() ||
+            any_of(I.operands(), [](const Use &Op) {
+              return Op->getType()->isVectorTy();
+            }))
+          ++S.VectorInstructions;
+      }
+      ++S.Blocks;
+      S.Instructions += BlockSize;
+      S.MaxBlockSize = std::max(S.MaxBlockSize, BlockSize);
+    }
+  });
+}
+
+/// Builds the table of the function statistics page from the JSON data in
+/// it, and sorts and filters it. A row holds the name and anchor of the
+/// function followed by its counts, in the order of FunctionStats.
+static const char *const FunctionStatsScript = R"(
+(function () {
+  var data = JSON.parse(document.getElementById("stats-data").textContent);
+  function column(name, index) {
+    return [name, function (r) { return r[index]; }];
+  }
+  var columns = [
+    column("function", 0), column("instructions", 2), column("blocks", 3),
+    column("calls", 4), column("loads", 5), column("stores", 6),
+    column("allocas", 7), column("vector", 8), column("phis", 9),
+    column("max block", 10),
+    ["debug %", function (r) {
+      return r[2] ? Math.round(1000 * r[11] / r[2]) / 10 : 0;
+    }],
+    column("bytes", 12)
+  ];
+  function escape(text) {
+    return String(text).replace(/&/g, "&amp;").replace(/</g, "&lt;")
+                       .replace(/>/g, "&gt;").replace(/"/g, "&quot;");
+  }
+
+  var table = document.getElementById("stats");
+  var filter = document.getElementById("filter");
+  var sortColumn = columns.length - 1, descending = true;
+  function render() {
+    var text = filter.value.toLowerCase();
+    var rows = data.rows.filter(function (r) {
+      return r[0].toLowerCase().indexOf(text) >= 0;
+    });
+    var key = columns[sortColumn][1];
+    rows.sort(function (a, b) {
+      var x = key(a), y = key(b);
+      var order = x < y ? -1 : x > y ? 1 : 0;
+      return descending ? -order : order;
+    });
+    var page = escape(data.page);
+    var html = rows.map(function (r) {
+      var cells = "<td><a href=\"" + page + "#" + r[1] + "\">" +
+                  escape(r[0]) + "</a></td>";
+      for (var i = 1; i < columns.length; ++i)
+        cells += "<td>" + columns[i][1](r) + "</td>";
+      return "<tr>" + cells + "</tr>";
+    });
+    table.tBodies[0].innerHTML = html.join("");
+  }
+
+  columns.forEach(function (c, i) {
+    var th = document.createElement("th");
+    th.textContent = c[0];
+    th.addEventListener("click", function () {
+      descending = sortColumn === i ? !descending : i !== 0;
+      sortColumn = i;
+      render();
+    });
+    table.tHead.rows[0].appendChild(th);
+  });
+  filter.addEventListener("input", render);
+  render();
+})();
+)";
+
+/// writeFunctionStatsPage - Write FunctionStatsRows to the function
+/// statistics page as compact JSON, from which its script builds the table.
+void HTMLAssemblyWriter::writeFunctionStatsPage(StringRef Title) {
+  std::string Path = Options.OutputPath + ".stats.html";
+  std::error_code EC;
+  raw_fd_ostream OS(Path, EC, sys::fs::OF_Text);
+  if (EC) {
+    WithColor::warning() << Path << ": " << EC.message() << '\n';
+    return;
+  }
+  addSidecar(Path);
+
+  std::string Data;
+  raw_string_ostream DataOS(Data);
+  {
+    json::OStream J(DataOS);
+    J.object([&] {
+      J.attribute("page", getPageURL());
+      J.attributeArray("rows", [&] {
+        for (const FunctionStats &S : FunctionStatsRows) {
+          std::string Name;
+          raw_string_ostream NameOS(Name);
+          if (S.F->hasName())
+            PrintLLVMName(NameOS, S.F);
+          else
+            NameOS << '@' << Machine.getGlobalSlot(S.F);
+          J.array([&] {
+            J.value(json::isUTF8(NameOS.str()) ? NameOS.str()
+                                               : json::fixUTF8(NameOS.str()));
+            J.value(getHTMLId(getHTMLTag(S.F)));
+            for (uint64_t N :
+                 {uint64_t(S.Instructions), uint64_t(S.Blocks),
+                  uint64_t(S.Calls), uint64_t(S.Loads), uint64_t(S.Stores),
+                  uint64_t(S.Allocas), uint64_t(S.VectorInstructions),
+                  uint64_t(S.PHIs), uint64_t(S.MaxBlockSize),
+                  uint64_t(S.DebugIntrinsics), S.RenderedBytes})
+              J.value(N);
+          });
+        }
+      });
+    });
+  }
+  DataOS.flush();
+
+  OS << "<!DOCTYPE html>\n";
+  OS << "<html>\n";
+  OS << "<head>\n";
+  OS << "<style>\n";
+  OS << "a:link, a:visited { color:black; text-decoration:none; }\n";
+  OS << "table { border-collapse: collapse; font-family: monospace; }\n";
+  OS << "th { cursor: pointer; text-align: right; padding: 0 0.5em; }\n";
+  OS << "td { text-align: right; padding: 0 0.5em; }\n";
+  OS << "th:first-child, td:first-child { text-align: left; }\n";
+  OS << "tr:nth-child(even) { background-color: #eee; }\n";
+  OS << "</style>\n";
+  OS << "<title>";
+  printHTMLEscaped(OS, Title);
+  OS << " functions</title>\n";
+  OS << "</head>\n";
+  OS << "<body>\n";
+  OS << "<h1><a href=\"";
+  printHTMLEscaped(OS, getPageURL());
+  OS << "\">";
+  printHTMLEscaped(OS, Title);
+  OS << "</a></h1>\n";
+  OS << "<input id=\"filter\" placeholder=\"Filter\">\n";
+  OS << "<table id=\"stats\"><thead><tr></tr></thead><tbody></tbody></table>\n";
+  // Names may hold "</script>"; '<' only occurs in JSON strings, where it can
+  // be escaped.
+  OS << "<script id=\"stats-data\" type=\"application/json\">";
+  for (char C : Data) {
+    if (C == '<')
+      OS << "\\u003c";
+    else
+      OS << C;
+  }
+  OS << "</script>\n";
+  OS << "<script>" << FunctionStatsScript << "</script>\n";
+  OS << "</body>\n";
+  OS << "</html>\n";
+  OS.close();
+  if (OS.has_error()) {
+    WithColor::warning() << Path << ": " << OS.error().message() << '\n';
+    OS.clear_error();
+  }
 }
 
-void HTMLAssemblyWriter::writeAllMDNodes() {
+void HTMLAssemblyWriter::writeAllMDNodes(raw_ostream &OS) {
   SmallVector<const MDNode *, 16> Nodes;
   Nodes.resize(Machine.mdn_size());
   for (auto &I : llvm::make_range(Machine.mdn_begin(), Machine.mdn_end()))
     Nodes[I.second] = cast<MDNode>(I.first);
 
+  if (Options.ParallelMetadata) {
+    writeMDNodesParallel(OS, Nodes);
+    return;
+  }
+
   for (unsigned i = 0, e = Nodes.size(); i != e; ++i) {
-    writeMDNode(i, Nodes[i]);
+    writeMDNode(OS, i, Nodes[i]);
+  }
+}
+
+// Metadata bodies are plain text that only read the IR and the slot tables, so
+// contiguous slot ranges are rendered concurrently, each with its own type
+// printer and foreign slot cache, and then written out in slot order. Only a
+// bounded number of ranges is held in memory at a time.
+void HTMLAssemblyWriter::writeMDNodesParallel(raw_ostream &OS,
+                                              ArrayRef<const MDNode *> Nodes) {
+  static constexpr unsigned NodesPerRange = 1024;
+
+  struct MDNodeRange {
+    unsigned Begin = 0;
+    unsigned End = 0;
+    std::string Text;
+    std::unique_ptr<TypePrinting> TypePrinter;
+    ForeignSlotCache ForeignSlots;
+  };
+
+  unsigned NumRanges =
+      std::min<size_t>(parallel::strategy.compute_thread_count() * 4,
+                       divideCeil(Nodes.size(), NodesPerRange));
+  if (NumRanges <= 1) {
+    for (unsigned i = 0, e = Nodes.size(); i != e; ++i)
+      writeMDNode(OS, i, Nodes[i]);
+    return;
+  }
+
+  // Nothing may be numbered lazily once the workers are running.
+  Machine.initializeIfNeeded();
+
+  std::vector<MDNodeRange> Ranges(NumRanges);
+  for (MDNodeRange &R : Ranges) {
+    R.TypePrinter = std::make_unique<TypePrinting>();
+    R.TypePrinter->copyNumbering(TypePrinter);
+    R.ForeignSlots.setPrecomputedSlotTables(Machine.getPrecomputedSlotTables());
+  }
+
+  for (unsigned Begin = 0, E = Nodes.size(); Begin != E;) {
+    for (MDNodeRange &R : Ranges) {
+      R.Begin = Begin;
+      R.End = std::min<unsigned>(Begin + NodesPerRange, E);
+      Begin = R.End;
+    }
+
+    parallelForEach(Ranges, [&](MDNodeRange &R) {
+      raw_string_ostream RangeOS(R.Text);
+      AsmWriterContext WriterCtx(R.TypePrinter.get(), &Machine, TheModule);
+      WriterCtx.ForeignSlots = &R.ForeignSlots;
+      WriterCtx.MetadataURL = &MetadataURL;
+      for (unsigned i = R.Begin; i != R.End; ++i) {
+        writeMDNodeDef(RangeOS, i, MetadataURL);
+        WriteMDNodeBodyInternal(RangeOS, Nodes[i], WriterCtx);
+        RangeOS << "\n";
+      }
+    });
+
+    for (MDNodeRange &R : Ranges) {
+      OS << R.Text;
+      R.Text.clear();
+    }
   }
 }
 
@@ -4936,29 +7448,71 @@ void HTMLAssemblyWriter::printMDNodeBody(const MDNode *Node) {
   WriteMDNodeBodyInternal(Out, Node, WriterCtx);
 }
 
-void HTMLAssemblyWriter::writeAttribute(const Attribute &Attr, bool InAttrGroup) {
+void HTMLAssemblyWriter::writeAttribute(raw_ostream &OS, const Attribute &Attr,
+                                        bool InAttrGroup) {
   if (!Attr.isTypeAttribute()) {
-    Out << Attr.getAsString(InAttrGroup);
+    OS << Attr.getAsString(InAttrGroup);
     return;
   }
 
-  Out << Attribute::getNameFromAttrKind(Attr.getKindAsEnum());
+  OS << Attribute::getNameFromAttrKind(Attr.getKindAsEnum());
   if (Type *Ty = Attr.getValueAsType()) {
-    Out << '(';
-    TypePrinter.print(Ty, Out);
-    Out << ')';
+    OS << '(';
+    TypePrinter.print(Ty, OS);
+    OS << ')';
   }
 }
 
 void HTMLAssemblyWriter::writeAttributeSet(const AttributeSet &AttrSet,
                                        bool InAttrGroup) {
-  bool FirstAttr = true;
-  for (const auto &Attr : AttrSet) {
-    if (!FirstAttr)
-      Out << ' ';
-    writeAttribute(Attr, InAttrGroup);
-    FirstAttr = false;
+  Out << getAttributeSetString(AttrSet,
+                               InAttrGroup ? ASK_InAttrGroup : ASK_Plain);
+}
+
+/// getAttributeSetString - Return the text of \p AS rendered as \p Kind,
+/// rendering it on first use.
+const std::string &
+HTMLAssemblyWriter::getAttributeSetString(AttributeSet AS,
+                                          AttributeSetStringKind Kind) {
+  auto [I, Inserted] = AttributeSetStrings[Kind].try_emplace(AS);
+  if (!Inserted)
+    return I->second;
+
+  raw_string_ostream OS(I->second);
+  ListSeparator LS(" ");
+  switch (Kind) {
+  case ASK_Plain:
+  case ASK_InAttrGroup:
+    for (const auto &Attr : AS) {
+      OS << LS;
+      writeAttribute(OS, Attr, Kind == ASK_InAttrGroup);
+    }
+    break;
+  case ASK_Return:
+    OS << AS.getAsString();
+    break;
+  case ASK_FnComment:
+    for (const Attribute &Attr : AS)
+      if (!Attr.isStringAttribute())
+        OS << LS << Attr.getAsString();
+    break;
+  case ASK_NumKinds:
+    llvm_unreachable("Not an attribute set rendering");
+  }
+  OS.flush();
+  return I->second;
+}
+
+/// Write " #N" for the attribute group of \p AS, linked to its definition.
+void HTMLAssemblyWriter::writeAttributeGroupRef(AttributeSet AS) {
+  int Slot = Machine.getAttributeGroupSlot(AS);
+  Out << ' ';
+  if (Slot == -1) {
+    Out << "#-1";
+    return;
   }
+  writeDefRefOpen(Out, "attr", Slot);
+  Out << '#' << Slot << "</a>";
 }
 
 void HTMLAssemblyWriter::writeAllAttributeGroups() {
@@ -4968,9 +7522,12 @@ void HTMLAssemblyWriter::writeAllAttributeGroups() {
   for (auto &I : llvm::make_range(Machine.as_begin(), Machine.as_end()))
     asVec[I.second] = I;
 
-  for (const auto &I : asVec)
-    Out << "attributes #" << I.second << " = { "
-        << I.first.getAsString(true) << " }\n";
+  for (const auto &I : asVec) {
+    Out << "attributes ";
+    writeDefOpen(Out, "attr", I.second);
+    Out << '#' << I.second << "</a> = { " << I.first.getAsString(true)
+        << " }\n";
+  }
 }
 
 void HTMLAssemblyWriter::printUseListOrder(const Value *V,
@@ -5008,20 +7565,122 @@ void HTMLAssemblyWriter::printUseLists(const Function *F) {
     printUseListOrder(Pair.first, Pair.second);
 }
 
+struct HTMLWriterPrimitives::Impl {
+  raw_null_ostream Null;
+  RedirectableStream PageOS{Null};
+  RedirectableStream StylesOS{Null};
+  formatted_raw_ostream Out{PageOS};
+  formatted_raw_ostream CSSOut{StylesOS};
+  SlotTracker Machine;
+  TypePrinting TypePrinter;
+  HTMLAssemblyWriter Writer;
+
+  Impl(const Module *M)
+      : Machine(M), TypePrinter(M),
+        Writer(Out, CSSOut, "", Machine, M, nullptr, /*IsForDebug=*/false) {
+    TypePrinter.setLinkNames(true);
+    Machine.initializeIfNeeded();
+    Writer.collectAllHTMLFunctionTags(M);
+  }
+};
+
+HTMLWriterPrimitives::HTMLWriterPrimitives(const Module *M)
+    : P(std::make_unique<Impl>(M)) {}
+
+HTMLWriterPrimitives::~HTMLWriterPrimitives() = default;
+
+void HTMLWriterPrimitives::printName(raw_ostream &OS, const Value &V) {
+  PrintLLVMName(OS, &V);
+}
+
+void HTMLWriterPrimitives::printType(raw_ostream &OS, Type *Ty) {
+  P->TypePrinter.print(Ty, OS);
+}
+
+void HTMLWriterPrimitives::printEscaped(raw_ostream &OS, StringRef Str) {
+  WriteEscapedStringFast(OS, Str);
+}
+
+unsigned HTMLWriterPrimitives::printOperands(raw_ostream &OS,
+                                             raw_ostream &CSSOS,
+                                             const Function &F) {
+  P->PageOS.redirect(OS);
+  P->StylesOS.redirect(CSSOS);
+  P->Machine.incorporateFunction(&F);
+  unsigned NumOperands = 0;
+  for (const BasicBlock &BB : F)
+    for (const Instruction &I : BB)
+      for (const Value *Op : I.operand_values()) {
+        P->Writer.writeOperand(Op, /*PrintType=*/true);
+        P->Out << '\n';
+        ++NumOperands;
+      }
+  P->Machine.purgeFunction();
+  P->Out.flush();
+  P->CSSOut.flush();
+  P->PageOS.redirect(P->Null);
+  P->StylesOS.redirect(P->Null);
+  return NumOperands;
+}
+
 //===----------------------------------------------------------------------===//
 //                       External Interface declarations
 //===----------------------------------------------------------------------===//
 
+void HTMLWriter::printSharedStyles(raw_ostream &OS) { writeMainStyles(OS); }
+
 void HTMLWriter::print(raw_ostream &ROS, raw_ostream &RCSSOS,
                        std::string CSSFileName,
                        AssemblyAnnotationWriter *AAW,
                        bool ShouldPreserveUseListOrder, bool IsForDebug) const {
   SlotTracker SlotTable(M);
-  formatted_raw_ostream OS(ROS);
+  std::unique_ptr<PrecomputedSlotTables> PrecomputedSlots;
+  if (Options.PrecomputeSlotTables || Options.ParallelMetadata) {
+    TimeRegion T(Options.Timers ? &Options.Timers->NumberSlots : nullptr);
+    TimeTraceScope TT("PrecomputeSlotTables");
+    PrecomputedSlots = std::make_unique<PrecomputedSlotTables>(*M);
+    SlotTable.setPrecomputedSlotTables(PrecomputedSlots.get());
+  }
+  // With a render cache or fold budgets, the page goes through a stream that
+  // functions and folded constructs can be captured from.
+  RedirectableStream PageOS(ROS);
+  bool UseCache = !Options.CacheDir.empty();
+  bool UsePageStream =
+      UseCache || Options.hasFoldBudgets() || Options.Outline;
+  formatted_raw_ostream OS(UsePageStream ? static_cast<raw_ostream &>(PageOS)
+                                         : ROS);
   formatted_raw_ostream CSSOS(RCSSOS);
   HTMLAssemblyWriter W(OS, CSSOS, CSSFileName, SlotTable, M, AAW, IsForDebug,
-                       ShouldPreserveUseListOrder);
+                       ShouldPreserveUseListOrder, Options);
+  if (UsePageStream)
+    W.setPageStream(PageOS);
+  if (UseCache)
+    W.enableRenderCache();
   W.printModule(M);
+  W.saveRenderCache();
+}
+
+void HTMLWriter::printFunction(raw_ostream &ROS, raw_ostream &RCSSOS,
+                               const Function &F) const {
+  SlotTracker SlotTable(M);
+  SlotTable.restrictToFunction(&F);
+  RedirectableStream PageOS(ROS);
+  formatted_raw_ostream OS(PageOS);
+  formatted_raw_ostream CSSOS(RCSSOS);
+  HTMLAssemblyWriter W(OS, CSSOS, "", SlotTable, M, nullptr,
+                       /*IsForDebug=*/false, /*ShouldPreserveUseListOrder=*/false,
+                       Options);
+  W.setPageStream(PageOS);
+  W.printFunctionPage(&F);
+}
+
+void HTMLSummaryWriter::print(raw_ostream &ROS, bool IsForDebug) const {
+  SlotTracker SlotTable(Index);
+  formatted_raw_ostream OS(ROS);
+  // Entries go straight to the output as they are printed; the page has no
+  // separate stylesheet.
+  HTMLAssemblyWriter W(OS, OS, "", SlotTable, Index, IsForDebug);
+  W.printModuleSummaryIndex();
 }
 /*
 void NamedMDNode::print(raw_ostream &ROS, bool IsForDebug) const {
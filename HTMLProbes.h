@@ -0,0 +1,93 @@
+//===- HTMLProbes.h - Static tracepoints of llvm-html -----------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// USDT probes in the rendering pipeline, for bpftrace, perf and other tools
+// that attach to SystemTap-style tracepoints. They are compiled in when
+// <sys/sdt.h> is available and LLVM_HTML_DISABLE_PROBES is not defined, and
+// are no-ops that do not evaluate their arguments otherwise. The provider is
+// "llvm_html"; names are passed as a pointer and a length since they are not
+// null terminated:
+//
+//   module_load_start(const char *file, size_t file_len)
+//   module_load_end(const char *file, size_t file_len, uint64_t instructions)
+//   function_render_start(const char *name, size_t name_len,
+//                         unsigned instructions)
+//   function_render_end(const char *name, size_t name_len,
+//                       unsigned instructions)
+//   metadata_start(unsigned nodes)
+//   metadata_end(unsigned nodes)
+//   output_flush(const char *file, size_t file_len, uint64_t bytes)
+//
+// For example:
+//
+//   bpftrace -e 'usdt:./llvm-html:llvm_html:function_render_start
+//                { @start[tid] = nsecs; }
+//                usdt:./llvm-html:llvm_html:function_render_end
+//                { @ns = hist(nsecs - @start[tid]); }'
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TOOLS_LLVM_HTML_HTMLPROBES_H
+#define LLVM_TOOLS_LLVM_HTML_HTMLPROBES_H
+
+#if !defined(LLVM_HTML_DISABLE_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define LLVM_HTML_PROBES_ENABLED 1
+#endif
+#endif
+
+#ifdef LLVM_HTML_PROBES_ENABLED
+// Every probe has a semaphore, which tracers raise while they are attached
+// to it. Arguments that take work to compute are only computed when
+// LLVM_HTML_PROBE_ACTIVE says a tracer is listening. The semaphores are
+// defined in HTMLAsmWriter.cpp.
+#define LLVM_HTML_PROBE_SEMAPHORE(Name) llvm_html_##Name##_semaphore
+extern "C" {
+extern volatile unsigned short llvm_html_module_load_start_semaphore;
+extern volatile unsigned short llvm_html_module_load_end_semaphore;
+extern volatile unsigned short llvm_html_function_render_start_semaphore;
+extern volatile unsigned short llvm_html_function_render_end_semaphore;
+extern volatile unsigned short llvm_html_metadata_start_semaphore;
+extern volatile unsigned short llvm_html_metadata_end_semaphore;
+extern volatile unsigned short llvm_html_output_flush_semaphore;
+}
+
+#define LLVM_HTML_PROBE_ACTIVE(Name) (LLVM_HTML_PROBE_SEMAPHORE(Name) != 0)
+#define LLVM_HTML_PROBE1(Name, A) DTRACE_PROBE1(llvm_html, Name, A)
+#define LLVM_HTML_PROBE2(Name, A, B) DTRACE_PROBE2(llvm_html, Name, A, B)
+#define LLVM_HTML_PROBE3(Name, A, B, C) DTRACE_PROBE3(llvm_html, Name, A, B, C)
+#else
+// The arguments are not evaluated, but still count as used, so that values
+// computed only for a probe do not warn.
+#define LLVM_HTML_PROBE_ACTIVE(Name) false
+#define LLVM_HTML_PROBE1(Name, A)                                              \
+  do {                                                                         \
+    if (false) {                                                               \
+      (void)(A);                                                               \
+    }                                                                          \
+  } while (0)
+#define LLVM_HTML_PROBE2(Name, A, B)                                           \
+  do {                                                                         \
+    if (false) {                                                               \
+      (void)(A);                                                               \
+      (void)(B);                                                               \
+    }                                                                          \
+  } while (0)
+#define LLVM_HTML_PROBE3(Name, A, B, C)                                        \
+  do {                                                                         \
+    if (false) {                                                               \
+      (void)(A);                                                               \
+      (void)(B);                                                               \
+      (void)(C);                                                               \
+    }                                                                          \
+  } while (0)
+#endif
+
+#endif // LLVM_TOOLS_LLVM_HTML_HTMLPROBES_H
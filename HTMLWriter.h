@@ -17,15 +17,255 @@
 
 using namespace llvm;
 
+/// The pages defining the globals of a set of modules rendered together, so
+/// that a module's declarations can link to the definitions on other pages.
+struct CrossModuleSymbolTable {
+  /// Absolute paths of the pages.
+  std::vector<std::string> Pages;
+
+  /// Index into Pages of the page defining each global, by GUID.
+  DenseMap<GlobalValue::GUID, unsigned> DefiningPage;
+};
+
+/// Counts of the work done by HTMLWriter::print.
+struct HTMLWriterStats {
+  /// Defined functions rendered from scratch.
+  unsigned FunctionsRendered = 0;
+
+  /// Defined functions copied from the render cache.
+  unsigned FunctionsReused = 0;
+};
+
+/// The time HTMLWriter::print spent rendering one defined function.
+struct HTMLFunctionTime {
+  std::string Name;
+  unsigned NumInstructions;
+  double Seconds;
+};
+
+/// The part of a page rendered for one defined function, or for the
+/// metadata, as byte ranges of the page and of its stylesheet.
+struct HTMLPageSection {
+  /// Name of the function; empty for the metadata section.
+  std::string Function;
+  uint64_t PageBegin = 0;
+  uint64_t PageEnd = 0;
+  uint64_t StylesBegin = 0;
+  uint64_t StylesEnd = 0;
+};
+
+/// Approximate bytes held at one phase boundary of a rendering. The parts
+/// that do not exist yet at that point are zero.
+struct HTMLMemorySample {
+  std::string Phase;
+  /// Peak resident set size of the process so far, or zero if unknown.
+  uint64_t PeakRSS = 0;
+  /// The module being rendered, with the metadata it refers to.
+  uint64_t IR = 0;
+  /// The anchor tags of the page.
+  uint64_t Tags = 0;
+  /// The uses recorded for each definition, which become def-use styles.
+  uint64_t DefToUse = 0;
+  /// The slot maps of module values, function values, metadata nodes and
+  /// attribute sets.
+  uint64_t ModuleSlots = 0;
+  uint64_t FunctionSlots = 0;
+  uint64_t MetadataSlots = 0;
+  uint64_t AttributeSlots = 0;
+  /// The numbered and named types and the rendered type strings.
+  uint64_t Types = 0;
+  /// The page and stylesheet written so far.
+  uint64_t Output = 0;
+
+  /// Sample the peak RSS, with \p IR as the size of the module.
+  static HTMLMemorySample take(StringRef Phase, uint64_t IR = 0);
+
+  /// Return the approximate bytes held by \p M and the metadata it refers
+  /// to. This walks the whole module; the IR does not change once it is
+  /// materialized, so the size is taken once and passed to every sample.
+  static uint64_t getApproximateIRSize(const Module &M);
+};
+
+/// Timers for the phases of HTMLWriter::print, started and stopped around
+/// each phase when set in HTMLWriterOptions::Timers.
+struct HTMLWriterTimers {
+  Timer CollectTags;
+  Timer NumberSlots;
+  Timer PrintBody;
+  Timer PrintCSSDefLinks;
+
+  explicit HTMLWriterTimers(TimerGroup &Group)
+      : CollectTags("collect-tags", "Collect function tags", Group),
+        NumberSlots("number-slots", "Number slots", Group),
+        PrintBody("print-body", "Print module body", Group),
+        PrintCSSDefLinks("print-css-def-links", "Print def-use styles",
+                         Group) {}
+};
+
+/// Options controlling how HTMLWriter renders a module.
+struct HTMLWriterOptions {
+  /// Global initializers taking more than this many bytes are summarized in
+  /// the page and written in full to a sidecar file. Zero prints every
+  /// initializer inline.
+  uint64_t MaxInitializerBytes = 0;
+
+  /// Constructs with more parts than these budgets print the parts within
+  /// the budget followed by a summary of the rest: switch cases, PHI
+  /// incoming pairs, instructions of a basic block and entries of its
+  /// "preds =" list. The rest goes to a sidecar page next to the page that
+  /// the summary links to, or to a collapsed region of the page when there
+  /// is no OutputPath. Zero prints every part.
+  unsigned MaxSwitchCases = 0;
+  unsigned MaxPhiIncoming = 0;
+  unsigned MaxBlockInstructions = 0;
+  unsigned MaxPredecessors = 0;
+
+  bool hasFoldBudgets() const {
+    return MaxSwitchCases || MaxPhiIncoming || MaxBlockInstructions ||
+           MaxPredecessors;
+  }
+
+  /// Print each defined function as its signature and a one-line summary of
+  /// its body, and leave out the metadata; metadata references are printed
+  /// as plain text. Bodies that are still materializable are not loaded.
+  bool Outline = false;
+
+  /// If set, the outline takes the sizes of the bodies that are not loaded
+  /// from this summary of the module.
+  const ModuleSummaryIndex *OutlineSummary = nullptr;
+
+  /// Path of the page being written. Sidecar files are written next to it and
+  /// named after it. Empty when the page goes to stdout, in which case no
+  /// sidecar files are written.
+  std::string OutputPath;
+
+  /// Number the values of all functions concurrently before printing starts,
+  /// instead of numbering each function right before it is printed.
+  bool PrecomputeSlotTables = false;
+
+  /// Discover the metadata of all functions concurrently and render the
+  /// metadata section in parallel slot ranges. Numbering is unchanged.
+  bool ParallelMetadata = false;
+
+  /// Write the metadata definitions to "<OutputPath>.metadata.html" and link
+  /// metadata references there, so they are only loaded when followed.
+  /// Ignored by an outline, which prints no metadata.
+  bool ShardMetadata = false;
+
+  /// Write the counts and rendered size of each defined function to
+  /// "<OutputPath>.stats.html", as a table that can be sorted and filtered,
+  /// and link it from the page. Functions whose bodies are not loaded are
+  /// left out.
+  bool FunctionStatsPage = false;
+
+  /// If set, references to globals defined on other pages link there, and
+  /// the globals defined here get anchors named after their GUID.
+  const CrossModuleSymbolTable *Symbols = nullptr;
+
+  /// If set, the style rules common to all pages are taken from this shared
+  /// stylesheet instead of being repeated in the page.
+  std::string StyleSheetURL;
+
+  /// If set, the rendered bodies of defined functions are cached in this
+  /// directory, keyed by a hash of everything their rendering depends on, and
+  /// copied from there when they are unchanged. The functions of a page are
+  /// kept together in one "llvmcache-" file, which llvm::pruneCache can prune.
+  std::string CacheDir;
+
+  /// If set, references to the functions defined in the module link to the
+  /// pages printed for them by HTMLWriter::printFunction: this prefix
+  /// followed by the GUID of the function.
+  std::string FunctionPageURLPrefix;
+
+  /// If set, the counts of this rendering are added to it.
+  HTMLWriterStats *Stats = nullptr;
+
+  /// If set, the phases of the rendering are timed with these timers.
+  HTMLWriterTimers *Timers = nullptr;
+
+  /// If set, the time spent rendering each defined function is appended to
+  /// it.
+  std::vector<HTMLFunctionTime> *FunctionTimes = nullptr;
+
+  /// If set, the memory held by the rendering is sampled at each phase
+  /// boundary and appended to it.
+  std::vector<HTMLMemorySample> *MemorySamples = nullptr;
+
+  /// The size of the module in MemorySamples, from
+  /// HTMLMemorySample::getApproximateIRSize. If zero, the writer takes it
+  /// itself on its first sample.
+  uint64_t IRBytes = 0;
+
+  /// If set, where each defined function and the metadata went in the page
+  /// is appended to it.
+  std::vector<HTMLPageSection> *Sections = nullptr;
+
+  /// If set, the path of each file written next to the page (the metadata
+  /// and statistics pages, initializer and fold sidecars) is appended to it.
+  std::vector<std::string> *Sidecars = nullptr;
+};
+
+/// Print \p Text escaped for HTML text and attribute values.
+void printHTMLEscaped(raw_ostream &OS, StringRef Text);
+
 class HTMLWriter {
 private:
   const Module *M;
+  HTMLWriterOptions Options;
 public:
-  HTMLWriter(const Module *M) : M(M) {}
+  HTMLWriter(const Module *M, HTMLWriterOptions Options = HTMLWriterOptions())
+      : M(M), Options(std::move(Options)) {}
 
   void print(raw_ostream &ROS, raw_ostream &CSSROS,
              std::string CSSFileName,
              AssemblyAnnotationWriter *AAW,
              bool ShouldPreserveUseListOrder = false,
              bool IsForDebug = false) const;
+
+  /// Print a page holding only function \p F of the module, followed by the
+  /// type, attribute group and metadata definitions it refers to.
+  void printFunction(raw_ostream &ROS, raw_ostream &CSSROS,
+                     const Function &F) const;
+
+  /// Write the stylesheet that pages with HTMLWriterOptions::StyleSheetURL
+  /// link to.
+  static void printSharedStyles(raw_ostream &OS);
+};
+
+/// The building blocks of a page, exposed one at a time so that their cost
+/// can be measured in isolation.
+class HTMLWriterPrimitives {
+private:
+  struct Impl;
+  std::unique_ptr<Impl> P;
+public:
+  HTMLWriterPrimitives(const Module *M);
+  ~HTMLWriterPrimitives();
+
+  /// Print the name of \p V with its sigil, quoted if needed.
+  void printName(raw_ostream &OS, const Value &V);
+
+  /// Print \p Ty, linking identified structs to their definitions.
+  void printType(raw_ostream &OS, Type *Ty);
+
+  /// Print \p Str escaped as in an IR string literal, with \XX for quotes,
+  /// backslashes and unprintable characters. It is not HTML-escaped.
+  void printEscaped(raw_ostream &OS, StringRef Str);
+
+  /// Print every operand of every instruction of \p F as a link, with the
+  /// style rules of the links going to \p CSSOS. Returns the number of
+  /// operands printed.
+  unsigned printOperands(raw_ostream &OS, raw_ostream &CSSOS,
+                         const Function &F);
+};
+
+/// Renders a ThinLTO summary index as a single HTML page in which every ^N
+/// reference links to its entry.
+class HTMLSummaryWriter {
+private:
+  const ModuleSummaryIndex *Index;
+public:
+  HTMLSummaryWriter(const ModuleSummaryIndex *Index) : Index(Index) {}
+
+  void print(raw_ostream &ROS, bool IsForDebug = false) const;
 };
@@ -0,0 +1,765 @@
+//===-- llvm-html-bench.cpp - Benchmarks for the HTML printer -------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//  llvm-html-bench [options] - Build synthetic modules of several shapes and
+//                              sizes, render them to HTML and report the
+//                              throughput of the whole page and of the
+//                              primitives it is made of.
+//  Options:
+//      --help   - Output information about command line switches
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/IR/AssemblyAnnotationWriter.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ModuleSummaryIndex.h"
+#include "llvm/IR/Type.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include "HTMLWriter.h"
+
+using namespace llvm;
+
+static cl::OptionCategory BenchCategory("HTML Benchmark Options");
+
+static cl::list<std::string>
+    Shapes("shapes", cl::CommaSeparated,
+           cl::desc("Module shapes to render (default: all of small-functions,"
+                    " giant-functions, debug-info, constant-tables,"
+                    " deep-types, block-addresses, instruction-mix)"),
+           cl::value_desc("shape,..."), cl::cat(BenchCategory));
+
+static cl::list<uint64_t>
+    Sizes("sizes", cl::CommaSeparated,
+          cl::desc("Approximate number of instructions of each module, or of "
+                   "table elements for constant-tables (default: 10000,"
+                   "1000000,10000000)"),
+          cl::value_desc("n,..."), cl::cat(BenchCategory));
+
+static cl::opt<uint64_t>
+    MicroSize("micro-size",
+              cl::desc("Number of instructions of the module the primitives "
+                       "are measured on, 0 to skip them (default: 100000)"),
+              cl::init(100000), cl::cat(BenchCategory));
+
+static cl::opt<unsigned>
+    Repetitions("repetitions",
+                cl::desc("Render each module this many times and report the "
+                         "fastest run (default: 1)"),
+                cl::init(1), cl::cat(BenchCategory));
+
+static cl::opt<bool> PrecomputeSlots(
+    "precompute-slots",
+    cl::desc("Render with HTMLWriterOptions::PrecomputeSlotTables"),
+    cl::cat(BenchCategory));
+
+static cl::opt<bool> ParallelMetadata(
+    "parallel-metadata",
+    cl::desc("Render with HTMLWriterOptions::ParallelMetadata"),
+    cl::cat(BenchCategory));
+
+//===----------------------------------------------------------------------===//
+// Operator new counting
+//===----------------------------------------------------------------------===//
+
+// Only calls to the global operator new are counted, including the aligned
+// ones that DenseMap and the other users of allocate_buffer make. Buffers
+// that grow through malloc and realloc, such as those of SmallVector, are
+// not, so the count is of operator new calls rather than of all
+// allocations.
+
+/// Number of calls to the global operator new so far, from any thread.
+static std::atomic<uint64_t> NumNewCalls(0);
+
+void *operator new(size_t Size) {
+  NumNewCalls.fetch_add(1, std::memory_order_relaxed);
+  if (void *Ptr = std::malloc(Size ? Size : 1))
+    return Ptr;
+  report_bad_alloc_error("Allocation failed");
+}
+
+void operator delete(void *Ptr) noexcept { std::free(Ptr); }
+
+void operator delete(void *Ptr, size_t) noexcept { std::free(Ptr); }
+
+void *operator new(size_t Size, std::align_val_t Align) {
+  NumNewCalls.fetch_add(1, std::memory_order_relaxed);
+  size_t Alignment = static_cast<size_t>(Align);
+#ifdef _WIN32
+  void *Ptr = _aligned_malloc(Size ? Size : 1, Alignment);
+#else
+  void *Ptr =
+      std::aligned_alloc(Alignment, alignTo(Size ? Size : 1, Alignment));
+#endif
+  if (Ptr)
+    return Ptr;
+  report_bad_alloc_error("Allocation failed");
+}
+
+void operator delete(void *Ptr, std::align_val_t) noexcept {
+#ifdef _WIN32
+  _aligned_free(Ptr);
+#else
+  std::free(Ptr);
+#endif
+}
+
+void operator delete(void *Ptr, size_t, std::align_val_t Align) noexcept {
+  operator delete(Ptr, Align);
+}
+
+namespace {
+
+/// A stream discarding its output and only counting its size.
+class CountingStream : public raw_ostream {
+  uint64_t Pos = 0;
+
+  void write_impl(const char *, size_t Size) override { Pos += Size; }
+  uint64_t current_pos() const override { return Pos; }
+
+public:
+  CountingStream() { SetBufferSize(1 << 16); }
+};
+
+/// Time and operator new calls spent in a piece of work.
+struct Measurement {
+  double Seconds = 0;
+  uint64_t NewCalls = 0;
+
+  template <typename Fn> static Measurement of(Fn Work) {
+    Measurement R;
+    uint64_t NewCalls = NumNewCalls.load(std::memory_order_relaxed);
+    auto Start = std::chrono::steady_clock::now();
+    Work();
+    auto End = std::chrono::steady_clock::now();
+    R.Seconds = std::chrono::duration<double>(End - Start).count();
+    R.NewCalls = NumNewCalls.load(std::memory_order_relaxed) - NewCalls;
+    return R;
+  }
+};
+
+//===----------------------------------------------------------------------===//
+// Synthetic modules
+//===----------------------------------------------------------------------===//
+
+/// Builds synthetic modules from a fixed seed, so that every run renders the
+/// same IR.
+class ModuleGenerator {
+  LLVMContext &Ctx;
+  std::unique_ptr<Module> M;
+  IRBuilder<> B;
+  std::minstd_rand RNG;
+  IntegerType *I32;
+  IntegerType *I64;
+
+  unsigned pick(unsigned N) { return RNG() % N; }
+
+  /// Append \p Count arithmetic instructions on the values of \p Pool to the
+  /// insertion block, adding their results to the pool.
+  void emitArithmetic(SmallVectorImpl<Value *> &Pool, unsigned Count) {
+    for (unsigned I = 0; I != Count; ++I) {
+      Value *L = Pool[pick(Pool.size())];
+      Value *R = Pool[pick(Pool.size())];
+      Value *V;
+      switch (pick(6)) {
+      case 0: V = B.CreateAdd(L, R, "sum"); break;
+      case 1: V = B.CreateSub(L, R, "diff"); break;
+      case 2: V = B.CreateMul(L, R, "prod"); break;
+      case 3: V = B.CreateXor(L, R); break;
+      case 4: V = B.CreateShl(L, B.getInt32(pick(31)), "shifted"); break;
+      default: V = B.CreateAnd(L, R); break;
+      }
+      Pool.push_back(V);
+    }
+  }
+
+  Function *createFunction(FunctionType *FTy, const Twine &Name) {
+    return Function::Create(FTy,
+                            pick(4) ? GlobalValue::ExternalLinkage
+                                    : GlobalValue::InternalLinkage,
+                            Name, *M);
+  }
+
+public:
+  ModuleGenerator(LLVMContext &Ctx, StringRef Name)
+      : Ctx(Ctx), M(std::make_unique<Module>(Name, Ctx)), B(Ctx), RNG(42),
+        I32(Type::getInt32Ty(Ctx)), I64(Type::getInt64Ty(Ctx)) {}
+
+  /// Many functions of about ten instructions, each calling the previous one.
+  std::unique_ptr<Module> buildSmallFunctions(uint64_t Size) {
+    FunctionType *FTy = FunctionType::get(I32, {I32, I32}, false);
+    Function *Prev = nullptr;
+    for (uint64_t NumInsts = 0, K = 0; NumInsts < Size; ++K) {
+      Function *F = createFunction(FTy, "small." + Twine(K));
+      B.SetInsertPoint(BasicBlock::Create(Ctx, "entry", F));
+      SmallVector<Value *, 16> Pool = {F->getArg(0), F->getArg(1)};
+      emitArithmetic(Pool, 5);
+      if (Prev)
+        Pool.push_back(B.CreateCall(Prev, {Pool[2], Pool[3]}, "call"));
+      Value *Cmp = B.CreateICmpSLT(Pool[0], Pool.back(), "cmp");
+      B.CreateRet(B.CreateSelect(Cmp, Pool[1], Pool.back()));
+      NumInsts += F->getInstructionCount();
+      Prev = F;
+    }
+    return std::move(M);
+  }
+
+  /// Four functions made of a chain of blocks that each may leave to a
+  /// common exit block, which merges all of their values in one phi.
+  std::unique_ptr<Module> buildGiantFunctions(uint64_t Size) {
+    FunctionType *FTy = FunctionType::get(I32, {I32, I32}, false);
+    const unsigned NumFunctions = 4;
+    const unsigned BlockSize = 32;
+    for (unsigned K = 0; K != NumFunctions; ++K) {
+      Function *F = createFunction(FTy, "giant." + Twine(K));
+      BasicBlock *Exit = BasicBlock::Create(Ctx, "exit", F);
+      BasicBlock *BB = BasicBlock::Create(Ctx, "entry", F, Exit);
+      SmallVector<Value *, 64> Pool = {F->getArg(0), F->getArg(1)};
+      SmallVector<std::pair<Value *, BasicBlock *>, 0> Exits;
+      for (uint64_t NumInsts = 0; NumInsts < Size / NumFunctions;
+           NumInsts += BlockSize + 3) {
+        B.SetInsertPoint(BB);
+        // Keep the pool bounded; all earlier values dominate the block anyway.
+        if (Pool.size() > 48)
+          Pool.erase(Pool.begin() + 2, Pool.end() - 16);
+        emitArithmetic(Pool, BlockSize);
+        Value *Cmp = B.CreateICmpEQ(Pool.back(), F->getArg(0), "done");
+        BasicBlock *Next = BasicBlock::Create(Ctx, "", F, Exit);
+        B.CreateCondBr(Cmp, Exit, Next);
+        Exits.push_back({Pool.back(), BB});
+        BB = Next;
+      }
+      B.SetInsertPoint(BB);
+      B.CreateBr(Exit);
+      Exits.push_back({Pool.back(), BB});
+      B.SetInsertPoint(Exit);
+      PHINode *Phi = B.CreatePHI(I32, Exits.size(), "result");
+      for (auto &Incoming : Exits)
+        Phi->addIncoming(Incoming.first, Incoming.second);
+      B.CreateRet(Phi);
+    }
+    return std::move(M);
+  }
+
+  /// Small functions in which every instruction has its own location in a
+  /// lexical block and its result described by a dbg.value.
+  std::unique_ptr<Module> buildDebugInfo(uint64_t Size) {
+    DIBuilder DIB(*M);
+    DIFile *File = DIB.createFile("bench.c", "/bench");
+    DIB.createCompileUnit(dwarf::DW_LANG_C99, File, "llvm-html-bench",
+                          /*isOptimized=*/true, "", 0);
+    DIBasicType *IntTy = DIB.createBasicType("int", 32, dwarf::DW_ATE_signed);
+    DISubroutineType *SubTy =
+        DIB.createSubroutineType(DIB.getOrCreateTypeArray({IntTy, IntTy, IntTy}));
+    FunctionType *FTy = FunctionType::get(I32, {I32, I32}, false);
+    unsigned Line = 1;
+    for (uint64_t NumInsts = 0, K = 0; NumInsts < Size; ++K) {
+      std::string Name = "debug." + std::to_string(K);
+      Function *F = createFunction(FTy, Name);
+      DISubprogram *SP = DIB.createFunction(
+          File, Name, Name, File, Line, SubTy, Line, DINode::FlagPrototyped,
+          DISubprogram::SPFlagDefinition);
+      F->setSubprogram(SP);
+      BasicBlock *BB = BasicBlock::Create(Ctx, "entry", F);
+      B.SetInsertPoint(BB);
+      SmallVector<Value *, 32> Pool = {F->getArg(0), F->getArg(1)};
+      DIScope *Scope = SP;
+      for (unsigned I = 0; I != 12; ++I) {
+        if (I % 4 == 0)
+          Scope = DIB.createLexicalBlock(Scope, File, Line, 3);
+        DILocation *Loc = DILocation::get(Ctx, Line, 1 + pick(40), Scope);
+        B.SetCurrentDebugLocation(Loc);
+        emitArithmetic(Pool, 1);
+        DILocalVariable *Var = DIB.createAutoVariable(
+            Scope, "v" + std::to_string(I), File, Line, IntTy);
+        DIB.insertDbgValueIntrinsic(Pool.back(), Var, DIB.createExpression(),
+                                    Loc, BB);
+        ++Line;
+      }
+      B.CreateRet(Pool.back());
+      B.SetCurrentDebugLocation(DebugLoc());
+      NumInsts += F->getInstructionCount();
+    }
+    DIB.finalize();
+    M->addModuleFlag(Module::Warning, "Debug Info Version",
+                     DEBUG_METADATA_VERSION);
+    return std::move(M);
+  }
+
+  /// Constant tables of integers, doubles, strings and records pointing at
+  /// each other, with a small accessor function per table.
+  std::unique_ptr<Module> buildConstantTables(uint64_t Size) {
+    const unsigned TableSize = 4096;
+    Type *PtrTy = PointerType::getUnqual(Ctx);
+    StructType *RecordTy =
+        StructType::create(Ctx, {I32, PtrTy, I64}, "struct.record");
+    FunctionType *FTy = FunctionType::get(PtrTy, {I64}, false);
+    GlobalVariable *Prev = nullptr;
+    for (uint64_t NumElements = 0, K = 0; NumElements < Size;
+         NumElements += TableSize, ++K) {
+      Constant *Init;
+      switch (K % 4) {
+      case 0: {
+        SmallVector<uint32_t, 0> Elements(TableSize);
+        for (uint32_t &E : Elements)
+          E = RNG();
+        Init = ConstantDataArray::get(Ctx, Elements);
+        break;
+      }
+      case 1: {
+        SmallVector<double, 0> Elements(TableSize);
+        for (double &E : Elements)
+          E = RNG() / 1024.0;
+        Init = ConstantDataArray::get(Ctx, Elements);
+        break;
+      }
+      case 2: {
+        std::string Str;
+        for (unsigned I = 0; I != TableSize; ++I)
+          Str += I % 7 ? char('a' + pick(26)) : " <&\"\\"[pick(5)];
+        Init = ConstantDataArray::getString(Ctx, Str, /*AddNull=*/false);
+        break;
+      }
+      default: {
+        SmallVector<Constant *, 0> Elements;
+        Constant *Target = Prev ? static_cast<Constant *>(Prev)
+                                : ConstantPointerNull::get(
+                                      PointerType::getUnqual(Ctx));
+        for (unsigned I = 0; I != TableSize / 3; ++I)
+          Elements.push_back(ConstantStruct::get(
+              RecordTy, {B.getInt32(I), Target, B.getInt64(RNG())}));
+        Init = ConstantArray::get(ArrayType::get(RecordTy, Elements.size()),
+                                  Elements);
+        break;
+      }
+      }
+      auto *GV = new GlobalVariable(*M, Init->getType(), /*isConstant=*/true,
+                                    GlobalValue::InternalLinkage, Init,
+                                    "table." + Twine(K));
+      Function *F = createFunction(FTy, "lookup." + Twine(K));
+      B.SetInsertPoint(BasicBlock::Create(Ctx, "entry", F));
+      B.CreateRet(B.CreateInBoundsGEP(Init->getType(), GV,
+                                      {B.getInt64(0), F->getArg(0)}, "elt"));
+      Prev = GV;
+    }
+    return std::move(M);
+  }
+
+  /// Functions walking a chain of structs nested two dozen levels deep, both
+  /// named and literal, with one long getelementptr per level.
+  std::unique_ptr<Module> buildDeepTypes(uint64_t Size) {
+    const unsigned Depth = 24;
+    Type *PtrTy = PointerType::getUnqual(Ctx);
+    SmallVector<StructType *, 0> Named;
+    Named.push_back(StructType::create(Ctx, {I32, I64}, "struct.d0"));
+    Type *Literal = StructType::get(Ctx, {I32, I64});
+    for (unsigned D = 1; D != Depth; ++D) {
+      Named.push_back(StructType::create(
+          Ctx, {Named.back(), ArrayType::get(Named.back(), 2), PtrTy},
+          "struct.d" + std::to_string(D)));
+      Literal = StructType::get(Ctx, {Literal, PtrTy});
+    }
+    FunctionType *FTy = FunctionType::get(I32, {I32}, false);
+    for (uint64_t NumInsts = 0, K = 0; NumInsts < Size; ++K) {
+      Function *F = createFunction(FTy, "deep." + Twine(K));
+      B.SetInsertPoint(BasicBlock::Create(Ctx, "entry", F));
+      Value *Obj = B.CreateAlloca(Named.back(), nullptr, "obj");
+      SmallVector<Value *, Depth + 1> Indices = {B.getInt32(0)};
+      for (unsigned D = 1; D < Depth; D += 4) {
+        Indices.append(4, B.getInt32(pick(2)));
+        Value *Ptr = B.CreateGEP(Named.back(), Obj, Indices, "field");
+        B.CreateStore(F->getArg(0), Ptr);
+      }
+      Value *Agg = B.CreateInsertValue(PoisonValue::get(Literal), Obj, {1});
+      Value *Leaf = B.CreateGEP(Named.back(), Obj, {B.getInt32(0)}, "leaf");
+      B.CreateStore(Agg, Leaf);
+      B.CreateRet(B.CreateLoad(I32, Leaf, "value"));
+      NumInsts += F->getInstructionCount();
+    }
+    return std::move(M);
+  }
+
+  /// Functions dispatching through indirectbr over unnamed blocks, whose
+  /// addresses are taken both locally and from the previous function.
+  std::unique_ptr<Module> buildBlockAddresses(uint64_t Size) {
+    const unsigned NumBlocks = 64;
+    Type *PtrTy = PointerType::getUnqual(Ctx);
+    ArrayType *TableTy = ArrayType::get(PtrTy, NumBlocks);
+    FunctionType *FTy = FunctionType::get(I32, {I64, PtrTy}, false);
+    Function *Prev = nullptr;
+    SmallVector<BasicBlock *, NumBlocks> PrevBlocks;
+    for (uint64_t NumInsts = 0, K = 0; NumInsts < Size; ++K) {
+      Function *F = createFunction(FTy, "dispatch." + Twine(K));
+      BasicBlock *Entry = BasicBlock::Create(Ctx, "entry", F);
+      SmallVector<BasicBlock *, NumBlocks> Blocks;
+      SmallVector<Constant *, NumBlocks> Addresses;
+      for (unsigned I = 0; I != NumBlocks; ++I) {
+        Blocks.push_back(BasicBlock::Create(Ctx, "", F));
+        Addresses.push_back(BlockAddress::get(F, Blocks.back()));
+      }
+      auto *Table = new GlobalVariable(
+          *M, TableTy, /*isConstant=*/true, GlobalValue::InternalLinkage,
+          ConstantArray::get(TableTy, Addresses), "targets." + Twine(K));
+      B.SetInsertPoint(Entry);
+      Value *Slot =
+          B.CreateInBoundsGEP(TableTy, Table, {B.getInt64(0), F->getArg(0)});
+      IndirectBrInst *Br =
+          B.CreateIndirectBr(B.CreateLoad(PtrTy, Slot, "target"), NumBlocks);
+      for (unsigned I = 0; I != NumBlocks; ++I) {
+        Br->addDestination(Blocks[I]);
+        B.SetInsertPoint(Blocks[I]);
+        Constant *Address =
+            Prev ? BlockAddress::get(Prev, PrevBlocks[I])
+                 : BlockAddress::get(F, Blocks[(I + 1) % NumBlocks]);
+        B.CreateStore(Address, F->getArg(1));
+        SmallVector<Value *, 8> Pool = {
+            B.CreateTrunc(F->getArg(0), I32, "index"), B.getInt32(I)};
+        emitArithmetic(Pool, 2);
+        B.CreateRet(Pool.back());
+      }
+      NumInsts += F->getInstructionCount();
+      Prev = F;
+      PrevBlocks = Blocks;
+    }
+    return std::move(M);
+  }
+
+  /// Functions switching to one block per opcode family the printer treats
+  /// specially: arithmetic and floating point, casts, atomics, vectors and
+  /// aggregates, and an invoke whose landing pad resumes.
+  std::unique_ptr<Module> buildInstructionMix(uint64_t Size) {
+    Type *PtrTy = PointerType::getUnqual(Ctx);
+    Type *DoubleTy = Type::getDoubleTy(Ctx);
+    auto *VecTy = FixedVectorType::get(I32, 4);
+    StructType *PadTy = StructType::get(Ctx, {PtrTy, I32});
+    FunctionCallee Callee = M->getOrInsertFunction(
+        "mix.callee", FunctionType::get(I32, {I32}, false));
+    FunctionCallee Personality = M->getOrInsertFunction(
+        "__gxx_personality_v0", FunctionType::get(I32, /*isVarArg=*/true));
+    FunctionType *FTy = FunctionType::get(I32, {I32, I32, PtrTy}, false);
+    for (uint64_t NumInsts = 0, K = 0; NumInsts < Size; ++K) {
+      Function *F = createFunction(FTy, "mix." + Twine(K));
+      F->setPersonalityFn(cast<Constant>(Personality.getCallee()));
+      Value *A = F->getArg(0), *Bv = F->getArg(1), *P = F->getArg(2);
+      BasicBlock *Entry = BasicBlock::Create(Ctx, "entry", F);
+      BasicBlock *Merge = BasicBlock::Create(Ctx, "merge", F);
+      auto NewCase = [&](const Twine &Name) {
+        BasicBlock *BB = BasicBlock::Create(Ctx, Name, F, Merge);
+        B.SetInsertPoint(BB);
+        return BB;
+      };
+      SmallVector<std::pair<Value *, BasicBlock *>, 8> Results;
+      auto Leave = [&](Value *V) {
+        Results.push_back({V, B.GetInsertBlock()});
+        B.CreateBr(Merge);
+      };
+
+      B.SetInsertPoint(Entry);
+      Value *Slot = B.CreateAlloca(I64, nullptr, "slot");
+      BasicBlock *Default = NewCase("default");
+      B.SetInsertPoint(Entry);
+      SwitchInst *Switch = B.CreateSwitch(A, Default, 5);
+      B.SetInsertPoint(Default);
+      Leave(B.CreateFreeze(Bv, "frozen"));
+
+      Switch->addCase(B.getInt32(0), NewCase("arith"));
+      SmallVector<Value *, 16> Pool = {A, Bv};
+      emitArithmetic(Pool, 4);
+      Value *FP = B.CreateSIToFP(Pool.back(), DoubleTy, "fp");
+      Value *FSum = B.CreateFAdd(FP, ConstantFP::get(DoubleTy, 0.5), "fsum");
+      Value *FNeg = B.CreateFNeg(FSum, "fneg");
+      Value *FCmp = B.CreateFCmpOLT(FNeg, FP, "fcmp");
+      Leave(B.CreateSelect(FCmp, B.CreateFPToSI(FNeg, I32, "int"), A));
+
+      Switch->addCase(B.getInt32(1), NewCase("casts"));
+      Value *Wide = B.CreateSExt(A, I64, "wide");
+      Value *Narrow = B.CreateTrunc(Wide, B.getInt16Ty(), "narrow");
+      Value *Addr = B.CreatePtrToInt(P, I64, "addr");
+      Value *Back = B.CreateIntToPtr(B.CreateAdd(Addr, Wide), PtrTy, "back");
+      Value *Pair = B.CreateBitCast(Wide, FixedVectorType::get(I32, 2), "pair");
+      B.CreateStore(B.CreateZExt(Narrow, I64, "ext"), Slot);
+      B.CreateStore(B.CreateExtractElement(Pair, uint64_t(0)), Back);
+      Leave(B.CreateTrunc(B.CreateLoad(I64, Slot, "reload"), I32));
+
+      Switch->addCase(B.getInt32(2), NewCase("atomics"));
+      Value *Old = B.CreateAtomicRMW(AtomicRMWInst::Add, P, A, Align(4),
+                                     AtomicOrdering::SequentiallyConsistent);
+      Value *CmpXchg = B.CreateAtomicCmpXchg(P, Old, Bv, Align(4),
+                                             AtomicOrdering::AcquireRelease,
+                                             AtomicOrdering::Monotonic);
+      B.CreateFence(AtomicOrdering::Release);
+      LoadInst *Acquired = B.CreateAlignedLoad(I32, P, Align(4), "acquired");
+      Acquired->setAtomic(AtomicOrdering::Acquire);
+      B.CreateAlignedStore(Acquired, P, Align(4))
+          ->setAtomic(AtomicOrdering::Release);
+      Leave(B.CreateExtractValue(CmpXchg, {0}, "prev"));
+
+      Switch->addCase(B.getInt32(3), NewCase("vectors"));
+      Value *Splat = B.CreateVectorSplat(4, A, "splat");
+      Value *Vec = B.CreateInsertElement(PoisonValue::get(VecTy), Bv,
+                                         uint64_t(1), "vec");
+      const int Mask[] = {0, 5, 2, 7};
+      Value *Mixed = B.CreateShuffleVector(Splat, Vec, Mask, "mixed");
+      Value *VSum = B.CreateAdd(Mixed, Splat, "vsum");
+      Value *Agg = B.CreateInsertValue(
+          PoisonValue::get(StructType::get(Ctx, {VecTy, I32})), VSum, {0});
+      Value *Lanes = B.CreateExtractValue(Agg, {0}, "lanes");
+      Leave(B.CreateExtractElement(Lanes, uint64_t(3), "lane"));
+
+      Switch->addCase(B.getInt32(4), NewCase("call"));
+      BasicBlock *Call = B.GetInsertBlock();
+      BasicBlock *Normal = NewCase("normal");
+      BasicBlock *Pad = NewCase("lpad");
+      B.SetInsertPoint(Call);
+      Value *Result = B.CreateInvoke(Callee, Normal, Pad, {A}, "result");
+      B.SetInsertPoint(Normal);
+      Leave(Result);
+      B.SetInsertPoint(Pad);
+      LandingPadInst *LP = B.CreateLandingPad(PadTy, 0, "exn");
+      LP->setCleanup(true);
+      B.CreateResume(LP);
+
+      B.SetInsertPoint(Merge);
+      PHINode *Phi = B.CreatePHI(I32, Results.size(), "merged");
+      for (auto &Incoming : Results)
+        Phi->addIncoming(Incoming.first, Incoming.second);
+      B.CreateRet(Phi);
+      NumInsts += F->getInstructionCount();
+    }
+    return std::move(M);
+  }
+};
+
+struct Shape {
+  const char *Name;
+  std::unique_ptr<Module> (ModuleGenerator::*Build)(uint64_t);
+};
+
+const Shape AllShapes[] = {
+    {"small-functions", &ModuleGenerator::buildSmallFunctions},
+    {"giant-functions", &ModuleGenerator::buildGiantFunctions},
+    {"debug-info", &ModuleGenerator::buildDebugInfo},
+    {"constant-tables", &ModuleGenerator::buildConstantTables},
+    {"deep-types", &ModuleGenerator::buildDeepTypes},
+    {"block-addresses", &ModuleGenerator::buildBlockAddresses},
+    {"instruction-mix", &ModuleGenerator::buildInstructionMix},
+};
+
+} // end anonymous namespace
+
+static std::unique_ptr<Module> buildModule(LLVMContext &Ctx,
+                                           const Shape &S, uint64_t Size) {
+  ModuleGenerator Generator(Ctx, S.Name);
+  return (Generator.*S.Build)(Size);
+}
+
+//===----------------------------------------------------------------------===//
+// Benchmarks
+//===----------------------------------------------------------------------===//
+
+static void printHeader(raw_ostream &OS) {
+  OS << "shape                  size instructions  build s  output MB  "
+        "render s           MB/s instructions/s\n"
+     << "                                                                 "
+        "           new calls     news/instr\n";
+}
+
+/// Render a module of shape \p S and size \p Size end to end and report its
+/// throughput.
+static void benchmarkPage(raw_ostream &OS, const Shape &S, uint64_t Size) {
+  LLVMContext Ctx;
+  std::unique_ptr<Module> M;
+  Measurement Build =
+      Measurement::of([&] { M = buildModule(Ctx, S, Size); });
+  uint64_t NumInsts = M->getInstructionCount();
+
+  HTMLWriterOptions Options;
+  Options.PrecomputeSlotTables = PrecomputeSlots;
+  Options.ParallelMetadata = ParallelMetadata;
+  HTMLWriter Writer(M.get(), Options);
+
+  Measurement Best;
+  uint64_t Bytes = 0;
+  for (unsigned R = 0; R != std::max(1u, unsigned(Repetitions)); ++R) {
+    CountingStream Page, Styles;
+    Measurement Run = Measurement::of([&] {
+      Writer.print(Page, Styles, "bench.css", nullptr);
+      Page.flush();
+      Styles.flush();
+    });
+    if (R == 0 || Run.Seconds < Best.Seconds)
+      Best = Run;
+    Bytes = Page.tell() + Styles.tell();
+  }
+
+  double MB = Bytes / 1e6;
+  OS << format("%-16s %10llu %12llu %8.2f %10.1f %9.3f %14.1f %14.0f\n",
+               S.Name, (unsigned long long)Size, (unsigned long long)NumInsts,
+               Build.Seconds, MB, Best.Seconds, MB / Best.Seconds,
+               NumInsts / Best.Seconds)
+     << format("%85llu %14.2f\n", (unsigned long long)Best.NewCalls,
+               double(Best.NewCalls) / std::max<uint64_t>(NumInsts, 1));
+  OS.flush();
+}
+
+static void reportPrimitive(raw_ostream &OS, StringRef Name, uint64_t Ops,
+                            uint64_t Bytes, const Measurement &Run) {
+  Ops = std::max<uint64_t>(Ops, 1);
+  OS << format("%-16s %12llu %10.1f %12.1f %10.1f %12.3f\n", Name.data(),
+               (unsigned long long)Ops, Run.Seconds * 1e9 / Ops,
+               Bytes / 1e6 / Run.Seconds, Bytes / double(Ops),
+               double(Run.NewCalls) / Ops);
+}
+
+/// Measure the primitives every page is made of, one at a time, over the
+/// values of a module of small functions.
+static void benchmarkPrimitives(raw_ostream &OS, uint64_t Size) {
+  LLVMContext Ctx;
+  std::unique_ptr<Module> M = buildModule(Ctx, AllShapes[0], Size);
+  // Mix in deep types so that type printing is not only about i32.
+  ModuleGenerator Types(Ctx, "types");
+  std::unique_ptr<Module> TypesModule = Types.buildDeepTypes(Size / 10);
+
+  SmallVector<const Value *, 0> Values;
+  SmallVector<Type *, 0> ValueTypes;
+  for (const Module *Mod : {M.get(), TypesModule.get()})
+    for (const Function &F : *Mod) {
+      Values.push_back(&F);
+      ValueTypes.push_back(F.getFunctionType());
+      for (const BasicBlock &BB : F)
+        for (const Instruction &I : BB) {
+          if (I.hasName())
+            Values.push_back(&I);
+          ValueTypes.push_back(I.getType());
+          for (const Value *Op : I.operand_values())
+            ValueTypes.push_back(Op->getType());
+        }
+    }
+
+  HTMLWriterPrimitives Names(M.get());
+  HTMLWriterPrimitives TypePrinter(TypesModule.get());
+  HTMLWriterPrimitives Links(M.get());
+
+  OS << "primitive                 ops      ns/op         MB/s   bytes/op"
+        "      news/op\n";
+  {
+    CountingStream Out;
+    Measurement Run = Measurement::of([&] {
+      for (const Value *V : Values)
+        Names.printName(Out, *V);
+      Out.flush();
+    });
+    reportPrimitive(OS, "name", Values.size(), Out.tell(), Run);
+  }
+  {
+    CountingStream Out;
+    Measurement Run = Measurement::of([&] {
+      for (Type *Ty : ValueTypes)
+        TypePrinter.printType(Out, Ty);
+      Out.flush();
+    });
+    reportPrimitive(OS, "type", ValueTypes.size(), Out.tell(), Run);
+  }
+  {
+    // Escape string literals the way c"..." initializers print them: plain
+    // identifiers as well as strings with quotes, backslashes and control
+    // characters.
+    SmallVector<std::string, 0> Strings;
+    for (const Value *V : Values)
+      Strings.push_back(V->getName().str());
+    for (unsigned I = 0; I != Values.size() / 4; ++I)
+      Strings.push_back("\"path\\" + std::to_string(I) + "\"\t\n\x01\x7f");
+    CountingStream Out;
+    uint64_t InBytes = 0;
+    Measurement Run = Measurement::of([&] {
+      for (const std::string &S : Strings) {
+        Names.printEscaped(Out, S);
+        InBytes += S.size();
+      }
+      Out.flush();
+    });
+    reportPrimitive(OS, "ir-escape", Strings.size(), InBytes, Run);
+  }
+  {
+    CountingStream Out, Styles;
+    uint64_t NumOperands = 0;
+    Measurement Run = Measurement::of([&] {
+      for (const Function &F : *M)
+        NumOperands += Links.printOperands(Out, Styles, F);
+      Out.flush();
+      Styles.flush();
+    });
+    reportPrimitive(OS, "link", NumOperands, Out.tell() + Styles.tell(), Run);
+  }
+  OS.flush();
+}
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+
+  cl::HideUnrelatedOptions(BenchCategory);
+  cl::ParseCommandLineOptions(argc, argv, "llvm .bc -> .html benchmarks\n");
+
+  SmallVector<const Shape *, 8> Selected;
+  if (Shapes.empty()) {
+    for (const Shape &S : AllShapes)
+      Selected.push_back(&S);
+  } else {
+    for (const std::string &Name : Shapes) {
+      const Shape *S = find_if(
+          AllShapes, [&](const Shape &S) { return Name == S.Name; });
+      if (S == std::end(AllShapes)) {
+        WithColor::error(errs(), argv[0]) << "unknown shape '" << Name << "'\n";
+        return 1;
+      }
+      Selected.push_back(S);
+    }
+  }
+  std::vector<uint64_t> SizeList(Sizes.begin(), Sizes.end());
+  if (SizeList.empty())
+    SizeList = {10000, 1000000, 10000000};
+
+  raw_ostream &OS = outs();
+  printHeader(OS);
+  for (const Shape *S : Selected)
+    for (uint64_t Size : SizeList)
+      benchmarkPage(OS, *S, Size);
+
+  if (MicroSize) {
+    OS << '\n';
+    benchmarkPrimitives(OS, MicroSize);
+  }
+  return 0;
+}
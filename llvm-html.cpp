@@ -13,7 +13,13 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/StringSwitch.h"
 #include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/IR/AssemblyAnnotationWriter.h"
 #include "llvm/IR/DebugInfo.h"
 #include "llvm/IR/DiagnosticInfo.h"
@@ -24,17 +30,46 @@
 #include "llvm/IR/ModuleSummaryIndex.h"
 #include "llvm/IR/ModuleSlotTracker.h"
 #include "llvm/IR/Type.h"
+#include "llvm/Support/CachePruning.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/FormattedStream.h"
 #include "llvm/Support/InitLLVM.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/WithColor.h"
+#include "llvm/Support/xxhash.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <numeric>
+#include <optional>
 #include <system_error>
 #include <regex>
+#include <thread>
+#ifdef LLVM_ON_UNIX
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 #include "HTMLWriter.h"
+#include "HTMLProbes.h"
 
 using namespace llvm;
 
@@ -82,6 +117,172 @@ static cl::opt<bool> PrintThinLTOIndexOnly(
     cl::desc("Only read thinlto index and print the index as LLVM assembly."),
     cl::init(false), cl::Hidden, cl::cat(HtmlCategory));
 
+static cl::opt<uint64_t> MaxInitializerBytes(
+    "max-initializer-bytes",
+    cl::desc("Summarize global initializers larger than this many bytes and "
+             "write them in full to a sidecar file (0 = no limit)"),
+    cl::value_desc("bytes"), cl::init(0), cl::cat(HtmlCategory));
+
+static cl::opt<unsigned> MaxSwitchCases(
+    "max-switch-cases",
+    cl::desc("Fold the cases of switch instructions past this many into a "
+             "sidecar page (0 = no limit)"),
+    cl::value_desc("cases"), cl::init(0), cl::cat(HtmlCategory));
+
+static cl::opt<unsigned> MaxPhiIncoming(
+    "max-phi-incoming",
+    cl::desc("Fold the incoming values of PHI nodes past this many into a "
+             "sidecar page (0 = no limit)"),
+    cl::value_desc("values"), cl::init(0), cl::cat(HtmlCategory));
+
+static cl::opt<unsigned> MaxBlockInstructions(
+    "max-block-instructions",
+    cl::desc("Fold the instructions of basic blocks past this many into a "
+             "sidecar page (0 = no limit)"),
+    cl::value_desc("instructions"), cl::init(0), cl::cat(HtmlCategory));
+
+static cl::opt<unsigned> MaxPredecessors(
+    "max-predecessors",
+    cl::desc("Fold the predecessors listed for basic blocks past this many "
+             "into a sidecar page (0 = no limit)"),
+    cl::value_desc("blocks"), cl::init(0), cl::cat(HtmlCategory));
+
+static cl::opt<bool>
+    Outline("outline",
+            cl::desc("Print the module without function bodies or metadata, "
+                     "with a one-line summary of each body, and without "
+                     "loading the bodies"),
+            cl::cat(HtmlCategory));
+
+static cl::opt<bool> OutlineBodies(
+    "outline-bodies",
+    cl::desc("With -outline, load the function bodies to count their blocks "
+             "and measure the size of their rendering"),
+    cl::cat(HtmlCategory));
+
+static cl::opt<bool> FunctionStatsPage(
+    "function-stats-page",
+    cl::desc("Write a sortable table of the size of each function to "
+             "<output>.stats.html"),
+    cl::cat(HtmlCategory));
+
+static cl::opt<bool> PrecomputeSlotTables(
+    "precompute-slots",
+    cl::desc("Number the values of all functions in parallel before "
+             "printing"),
+    cl::init(false), cl::cat(HtmlCategory));
+
+static cl::opt<bool> ParallelMetadata(
+    "parallel-metadata",
+    cl::desc("Number and render metadata in parallel; useful for modules "
+             "with a lot of debug info"),
+    cl::init(false), cl::cat(HtmlCategory));
+
+static cl::opt<bool> ShardMetadata(
+    "shard-metadata",
+    cl::desc("Write metadata definitions to a separate page that is only "
+             "loaded when a metadata link is followed"),
+    cl::init(false), cl::cat(HtmlCategory));
+
+static cl::opt<bool> LinkModules(
+    "link-modules",
+    cl::desc("When rendering several inputs, link declarations and imported "
+             "functions to the page of the module defining them"),
+    cl::init(false), cl::cat(HtmlCategory));
+
+static cl::opt<std::string> SiteDir(
+    "site-dir",
+    cl::desc("Render all inputs as a linked site in this directory, with a "
+             "shared stylesheet and an index of modules and exported "
+             "symbols. Unchanged inputs are not rendered again"),
+    cl::value_desc("directory"), cl::cat(HtmlCategory));
+
+static cl::opt<std::string> CacheDir(
+    "cache-dir",
+    cl::desc("Cache the rendering of each function in this directory and "
+             "reuse it while the function and the names it refers to are "
+             "unchanged"),
+    cl::value_desc("directory"), cl::cat(HtmlCategory));
+
+static cl::opt<std::string> CachePolicy(
+    "cache-policy",
+    cl::desc("Pruning policy of the --cache-dir cache, in the syntax of the "
+             "ThinLTO cache policy, e.g. prune_after=24h:cache_size_bytes=1g"),
+    cl::value_desc("policy"), cl::cat(HtmlCategory));
+
+static cl::opt<std::string> Serve(
+    "serve",
+    cl::desc("Serve the input on this loopback address instead of writing "
+             "pages; functions are rendered when they are first requested"),
+    cl::value_desc("127.0.0.1:port"), cl::cat(HtmlCategory));
+
+static cl::opt<unsigned> ServeCacheSize(
+    "serve-cache-size",
+    cl::desc("Megabytes of rendered function pages kept by --serve"),
+    cl::init(256), cl::cat(HtmlCategory));
+
+static cl::opt<bool> Watch(
+    "watch",
+    cl::desc("After rendering, keep watching the inputs and render them "
+             "again when they change, reusing unchanged functions"),
+    cl::init(false), cl::cat(HtmlCategory));
+
+static cl::opt<bool> TimePhases(
+    "time-phases",
+    cl::desc("Time each phase of reading and rendering the inputs, and print "
+             "the times with throughput counters at exit"),
+    cl::init(false), cl::cat(HtmlCategory));
+
+static cl::opt<std::string> TimePhasesJSON(
+    "time-phases-json",
+    cl::desc("Write the phase times and counters to this file as JSON"),
+    cl::value_desc("filename"), cl::cat(HtmlCategory));
+
+static cl::opt<bool> TimeTrace(
+    "time-trace",
+    cl::desc("Record a Chrome trace of reading and rendering the inputs, "
+             "with a span per function"),
+    cl::init(false), cl::cat(HtmlCategory));
+
+static cl::opt<std::string> TimeTraceFile(
+    "time-trace-file",
+    cl::desc("Write the trace to this file instead of next to the output"),
+    cl::value_desc("filename"), cl::cat(HtmlCategory));
+
+static cl::opt<unsigned> TimeTraceGranularity(
+    "time-trace-granularity",
+    cl::desc("Minimum time in microseconds of the spans in the trace"),
+    cl::init(500), cl::cat(HtmlCategory));
+
+static cl::opt<unsigned> SlowestFunctions(
+    "slowest-functions",
+    cl::desc("Print the N functions that took the longest to render"),
+    cl::value_desc("N"), cl::init(0), cl::cat(HtmlCategory));
+
+static cl::opt<bool> MemoryReport(
+    "memory-report",
+    cl::desc("Print the peak RSS and the approximate size of the module and "
+             "of the rendering structures at each phase of every input"),
+    cl::init(false), cl::cat(HtmlCategory));
+
+static cl::opt<bool> PageStats(
+    "page-stats",
+    cl::desc("Print what each page and each function in it costs the "
+             "browser: bytes of HTML, CSS and metadata, elements, anchors, "
+             "CSS rules and selectors"),
+    cl::init(false), cl::cat(HtmlCategory));
+
+static cl::list<std::string> Budget(
+    "budget", cl::CommaSeparated,
+    cl::desc("Warn about pages exceeding these limits; the limits are on "
+             "bytes, elements, anchors, css-rules and selectors"),
+    cl::value_desc("name=limit,..."), cl::cat(HtmlCategory));
+
+static cl::opt<bool> BudgetError(
+    "budget-error",
+    cl::desc("Fail instead of warning when a page exceeds its --budget"),
+    cl::init(false), cl::cat(HtmlCategory));
+
 namespace {
 
 static void printDebugLoc(const DebugLoc &DL, formatted_raw_ostream &OS) {
@@ -165,118 +366,1689 @@ static void inlineCSS(raw_ostream &OS, std::string &Out, std::string &CSS) {
   ReplacementString += "<style> \n";
   ReplacementString += CSS;
   ReplacementString += "</style> \n";
-  OS << std::regex_replace(Out, std::regex("<link.*>"), ReplacementString);
+  // Only the page's own stylesheet is inlined; a shared one stays linked.
+  OS << std::regex_replace(Out, std::regex("<link.*>"), ReplacementString,
+                           std::regex_constants::format_first_only);
 }
 
 static ExitOnError ExitOnErr;
 
-int main(int argc, char **argv) {
-  InitLLVM X(argc, argv);
+/// The suffix added to the site page names of the inputs whose names would
+/// otherwise collide, by input; see separateSitePages.
+static StringMap<std::string> SitePageSuffixes;
 
-  ExitOnErr.setBanner(std::string(argv[0]) + ": error: ");
+/// Return the page written for module \p I of the \p N modules in
+/// \p InputFilename.
+static std::string getOutputFilename(StringRef InputFilename, size_t I,
+                                     size_t N) {
+  if (!SiteDir.empty()) {
+    // All pages of a site live in one directory, so the input path is folded
+    // into the page name to keep inputs with the same name apart.
+    StringRef Stem = sys::path::remove_leading_dotslash(
+        InputFilename.endswith(".bc") ? InputFilename.drop_back(3)
+                                      : InputFilename);
+    std::string Name;
+    for (char C : Stem.ltrim("/\\"))
+      Name += (C == '/' || C == '\\' || C == ':') ? '_' : C;
+    auto Suffix = SitePageSuffixes.find(InputFilename);
+    if (Suffix != SitePageSuffixes.end())
+      Name += Suffix->second;
+    if (N > 1)
+      Name += std::string(".") + std::to_string(I);
+    SmallString<256> Path(SiteDir);
+    sys::path::append(Path, Name + ".html");
+    return std::string(Path);
+  }
 
-  cl::HideUnrelatedOptions({&HtmlCategory, &getColorCategory()});
-  cl::ParseCommandLineOptions(argc, argv, "llvm .bc -> .html emitter\n");
+  std::string FinalFilename(OutputFilename);
+  if (FinalFilename.empty()) { // Unspecified output, infer it.
+    if (InputFilename == "-")
+      return "-";
+    FinalFilename =
+        (InputFilename.endswith(".bc") ? InputFilename.drop_back(3)
+                                       : InputFilename)
+            .str();
+    if (N > 1)
+      FinalFilename += std::string(".") + std::to_string(I);
+    return FinalFilename + ".html";
+  }
+  if (N > 1)
+    FinalFilename += std::string(".") + std::to_string(I);
+  return FinalFilename;
+}
 
-  LLVMContext Context;
-  Context.setDiagnosticHandler(
-      std::make_unique<LLVMHtmlDiagnosticHandler>(argv[0]));
+/// What the pre-pass learns about one input.
+struct InputInfo {
+  std::string Filename;
+  /// Hash of the file contents.
+  uint64_t Hash = 0;
+  /// Hash of the globals the input defines and where they are rendered.
+  uint64_t DefinitionsHash = 0;
+  /// Absolute paths of the pages of the input's modules.
+  std::vector<std::string> Pages;
+  /// GUIDs of the globals defined by each module, by module number.
+  std::vector<std::pair<GlobalValue::GUID, unsigned>> Definitions;
+  /// Name, GUID and module number of the externally visible definitions;
+  /// only collected for sites.
+  struct Symbol {
+    std::string Name;
+    GlobalValue::GUID GUID;
+    unsigned ModuleIdx;
+  };
+  std::vector<Symbol> Exported;
+};
 
-  if (InputFilenames.size() < 1) {
-    InputFilenames.push_back("-");
-  } else if (InputFilenames.size() > 1 && !OutputFilename.empty()) {
-    errs()
-        << "error: output file name cannot be set for multiple input files\n";
-    return 1;
+/// Collect the globals defined by every module of every input, and the page
+/// each one is rendered to. The inputs are read concurrently, each module
+/// lazily in its own context.
+static std::vector<InputInfo> scanInputs(ArrayRef<std::string> Inputs,
+                                         bool CollectExported) {
+  std::vector<InputInfo> Infos(Inputs.size());
+  for (size_t I = 0, E = Inputs.size(); I != E; ++I)
+    Infos[I].Filename = Inputs[I];
+
+  parallelForEach(Infos, [&](InputInfo &In) {
+    if (In.Filename == "-")
+      return;
+    ErrorOr<std::unique_ptr<MemoryBuffer>> BufferOrErr =
+        MemoryBuffer::getFile(In.Filename);
+    if (!BufferOrErr)
+      return;
+    In.Hash = xxHash64((*BufferOrErr)->getBuffer());
+    Expected<BitcodeFileContents> IF =
+        getBitcodeFileContents(**BufferOrErr);
+    if (!IF) {
+      consumeError(IF.takeError());
+      return;
+    }
+
+    std::vector<uint64_t> Words;
+    const size_t N = IF->Mods.size();
+    for (size_t I = 0; I < N; ++I) {
+      SmallString<256> Page(getOutputFilename(In.Filename, I, N));
+      sys::fs::make_absolute(Page);
+      In.Pages.push_back(std::string(Page));
+
+      LLVMContext Ctx;
+      Expected<std::unique_ptr<Module>> M = IF->Mods[I].getLazyModule(
+          Ctx, /*ShouldLazyLoadMetadata=*/true, /*IsImporting=*/false);
+      if (!M) {
+        consumeError(M.takeError());
+        continue;
+      }
+      for (const GlobalValue &GV : (*M)->global_values()) {
+        if (!GV.hasName() || GV.isDeclaration() ||
+            GV.hasAvailableExternallyLinkage())
+          continue;
+        In.Definitions.emplace_back(GV.getGUID(), I);
+        Words.push_back(GV.getGUID());
+        Words.push_back(I);
+        if (CollectExported && !GV.hasLocalLinkage())
+          In.Exported.push_back({GV.getName().str(), GV.getGUID(), (unsigned)I});
+      }
+    }
+    In.DefinitionsHash = xxHash64(ArrayRef<uint8_t>(
+        reinterpret_cast<const uint8_t *>(Words.data()),
+        Words.size() * sizeof(uint64_t)));
+  });
+  return Infos;
+}
+
+/// Merge the scanned inputs in input order, so the first definition of a
+/// global wins whatever order the scan finished in.
+static void buildSymbolTable(ArrayRef<InputInfo> Infos,
+                             CrossModuleSymbolTable &Symbols) {
+  for (const InputInfo &In : Infos) {
+    unsigned FirstPage = Symbols.Pages.size();
+    Symbols.Pages.insert(Symbols.Pages.end(), In.Pages.begin(),
+                         In.Pages.end());
+    for (auto &[GUID, ModuleIdx] : In.Definitions)
+      Symbols.DefiningPage.try_emplace(GUID, FirstPage + ModuleIdx);
   }
+}
 
-  for (std::string InputFilename : InputFilenames) {
+namespace {
+/// The phase timers and counters of -time-phases.
+struct PhaseReport {
+  TimerGroup Group;
+  Timer Read;
+  Timer Parse;
+  Timer Materialize;
+  HTMLWriterTimers Writer;
+  Timer InlineCSS;
+
+  /// Defined functions rendered.
+  uint64_t Functions = 0;
+  /// Instructions rendered.
+  uint64_t Instructions = 0;
+  /// Anchors in the pages, both links and the definitions they lead to.
+  uint64_t Anchors = 0;
+  /// Style rules in the pages' stylesheets.
+  uint64_t CSSRules = 0;
+  uint64_t InputBytes = 0;
+  uint64_t OutputBytes = 0;
+
+  PhaseReport()
+      : Group("llvm-html", "llvm-html phases"),
+        Read("read", "Read input", Group),
+        Parse("parse", "Parse bitcode", Group),
+        Materialize("materialize", "Materialize module", Group),
+        Writer(Group), InlineCSS("inline-css", "Inline stylesheet", Group) {}
+
+  /// Print the report to the info output file and, if \p JSONPath is not
+  /// empty, to that file as JSON. The timers are cleared afterwards.
+  void print(StringRef JSONPath);
+};
+} // end anonymous namespace
+
+void PhaseReport::print(StringRef JSONPath) {
+  double WallTime = 0;
+  for (const Timer *T : {&Read, &Parse, &Materialize, &Writer.CollectTags,
+                         &Writer.NumberSlots, &Writer.PrintBody,
+                         &Writer.PrintCSSDefLinks, &InlineCSS})
+    WallTime += T->getTotalTime().getWallTime();
+  std::pair<const char *, uint64_t> Counters[] = {
+      {"functions", Functions},
+      {"instructions", Instructions},
+      {"anchors", Anchors},
+      {"css-rules", CSSRules},
+      {"input-bytes", InputBytes},
+      {"output-bytes", OutputBytes},
+      {"input-bytes-per-second",
+       WallTime > 0 ? uint64_t(InputBytes / WallTime) : 0}};
+
+  if (!JSONPath.empty()) {
+    std::error_code EC;
+    raw_fd_ostream OS(JSONPath, EC, sys::fs::OF_Text);
+    if (EC) {
+      WithColor::warning() << JSONPath << ": " << EC.message() << '\n';
+    } else {
+      OS << "{\n";
+      const char *Delim = Group.printJSONValues(OS, "");
+      for (auto &[Name, Value] : Counters) {
+        OS << Delim << "\t\"llvm-html." << Name << "\": " << Value;
+        Delim = ",\n";
+      }
+      OS << "\n}\n";
+    }
+  }
+
+  if (!TimePhases) {
+    Group.clear();
+    return;
+  }
+  std::unique_ptr<raw_ostream> OS = CreateInfoOutputFile();
+  Group.print(*OS, /*ResetAfterPrint=*/true);
+  *OS << "llvm-html counters:\n";
+  for (auto &[Name, Value] : Counters)
+    *OS << format("%16llu  %s\n", (unsigned long long)Value, Name);
+  OS->flush();
+}
+
+/// The report of -time-phases, if timing.
+static PhaseReport *Phases = nullptr;
+
+/// Return the timer of a phase, or null if phases are not timed.
+static Timer *getPhaseTimer(Timer PhaseReport::*Phase) {
+  return Phases ? &(Phases->*Phase) : nullptr;
+}
+
+/// The slowest functions rendered so far, with the input they are from.
+static std::vector<std::pair<std::string, HTMLFunctionTime>> SlowFunctions;
+static std::mutex SlowFunctionsLock;
+
+/// Add the functions of \p Input rendered in \p Times to SlowFunctions,
+/// keeping only the slowest.
+static void recordFunctionTimes(StringRef Input,
+                                ArrayRef<HTMLFunctionTime> Times) {
+  auto Slower = [](const std::pair<std::string, HTMLFunctionTime> &A,
+                   const std::pair<std::string, HTMLFunctionTime> &B) {
+    return A.second.Seconds > B.second.Seconds;
+  };
+  std::lock_guard<std::mutex> Lock(SlowFunctionsLock);
+  for (const HTMLFunctionTime &T : Times)
+    SlowFunctions.emplace_back(std::string(Input), T);
+  if (SlowFunctions.size() > SlowestFunctions) {
+    std::nth_element(SlowFunctions.begin(),
+                     SlowFunctions.begin() + SlowestFunctions,
+                     SlowFunctions.end(), Slower);
+    SlowFunctions.resize(SlowestFunctions);
+  }
+  llvm::sort(SlowFunctions, Slower);
+}
+
+/// Print what -time-phases, -time-trace and -slowest-functions collected.
+static void printReports() {
+  if (Phases)
+    Phases->print(TimePhasesJSON);
+
+  if (SlowestFunctions) {
+    raw_ostream &OS = errs();
+    OS << "slowest functions to render:\n";
+    for (auto &[Input, T] : SlowFunctions)
+      OS << format("%10.3f ms %10u instructions  ", T.Seconds * 1000,
+                   T.NumInstructions)
+         << Input << ": " << T.Name << '\n';
+  }
+
+  if (timeTraceProfilerEnabled()) {
+    // Without -time-trace-file, the trace is written next to the output.
+    std::string Fallback = "llvm-html";
+    if (!SiteDir.empty())
+      Fallback = SiteDir + "/llvm-html";
+    else if (!OutputFilename.empty() && OutputFilename != "-")
+      Fallback = OutputFilename;
+    else if (InputFilenames[0] != "-")
+      Fallback = InputFilenames[0];
+    if (Error E = timeTraceProfilerWrite(TimeTraceFile, Fallback))
+      WithColor::error() << toString(std::move(E)) << '\n';
+    timeTraceProfilerCleanup();
+  }
+}
+
+/// Print the -memory-report samples of \p Input.
+static void printMemoryReport(StringRef Input,
+                              ArrayRef<HTMLMemorySample> Samples) {
+  // Inputs may be rendered concurrently; print each report in one piece.
+  std::string Report;
+  raw_string_ostream OS(Report);
+  OS << "memory report for " << Input << " (KiB):\n"
+     << left_justify("phase", 16);
+  for (const char *Column :
+       {"peak-rss", "module", "tags", "def-use", "slots", "fn-slots",
+        "md-slots", "attr-slots", "types", "output"})
+    OS << ' ' << right_justify(Column, 10);
+  OS << '\n';
+  for (const HTMLMemorySample &S : Samples) {
+    OS << format("%-16s", S.Phase.c_str());
+    for (uint64_t Bytes :
+         {S.PeakRSS, S.IR, S.Tags, S.DefToUse, S.ModuleSlots, S.FunctionSlots,
+          S.MetadataSlots, S.AttributeSlots, S.Types, S.Output})
+      OS << format(" %10llu", (unsigned long long)(Bytes + 1023) / 1024);
+    OS << '\n';
+  }
+  errs() << OS.str();
+}
+
+namespace {
+/// What a page, or a part of it, costs the browser.
+struct PageMetrics {
+  uint64_t HTMLBytes = 0;
+  uint64_t CSSBytes = 0;
+  /// The part of HTMLBytes taken by the metadata section.
+  uint64_t MetadataBytes = 0;
+  uint64_t Elements = 0;
+  uint64_t Anchors = 0;
+  uint64_t CSSRules = 0;
+  uint64_t Selectors = 0;
+  /// Selectors with :has() or the ~ sibling combinator, which are the
+  /// expensive ones to match when the page is hovered over.
+  uint64_t HasSelectors = 0;
+  uint64_t SiblingSelectors = 0;
+
+  void addHTML(StringRef HTML);
+  void addCSS(StringRef CSS);
+
+  /// Return the metric limited by --budget=<Name>=..., or -1 if there is no
+  /// such metric.
+  int64_t getBudgetedMetric(StringRef Name) const;
+};
+} // end anonymous namespace
+
+void PageMetrics::addHTML(StringRef HTML) {
+  HTMLBytes += HTML.size();
+  for (size_t I = HTML.find('<'); I != StringRef::npos;
+       I = HTML.find('<', I + 1)) {
+    if (I + 1 == HTML.size() || !isAlpha(HTML[I + 1]))
+      continue;
+    ++Elements;
+    if (HTML.substr(I + 1).startswith("a "))
+      ++Anchors;
+  }
+}
+
+void PageMetrics::addCSS(StringRef CSS) {
+  CSSBytes += CSS.size();
+  for (size_t Open = CSS.find('{'); Open != StringRef::npos;
+       Open = CSS.find('{')) {
+    StringRef Prelude = CSS.take_front(Open).ltrim("} \t\r\n").rtrim();
+    size_t Close = CSS.find('}', Open);
+    CSS = Close == StringRef::npos ? StringRef() : CSS.drop_front(Close + 1);
+    ++CSSRules;
+    for (StringRef Rest = Prelude; !Rest.empty();) {
+      StringRef Selector;
+      std::tie(Selector, Rest) = Rest.split(',');
+      ++Selectors;
+      if (Selector.contains(":has("))
+        ++HasSelectors;
+      if (Selector.contains('~'))
+        ++SiblingSelectors;
+    }
+  }
+}
+
+int64_t PageMetrics::getBudgetedMetric(StringRef Name) const {
+  return StringSwitch<int64_t>(Name)
+      .Case("bytes", HTMLBytes + CSSBytes)
+      .Case("elements", Elements)
+      .Case("anchors", Anchors)
+      .Case("css-rules", CSSRules)
+      .Case("selectors", Selectors)
+      .Default(-1);
+}
+
+/// The limits of --budget, by metric.
+static StringMap<uint64_t> BudgetLimits;
+
+/// Parse --budget into BudgetLimits. Returns false if it is malformed.
+static bool parseBudget() {
+  for (StringRef Limit : Budget) {
+    auto [Name, Value] = Limit.split('=');
+    uint64_t N;
+    if (PageMetrics().getBudgetedMetric(Name) < 0 ||
+        Value.getAsInteger(0, N)) {
+      WithColor::error() << "invalid --budget limit '" << Limit
+                         << "'; expected <name>=<number> with a name of "
+                            "bytes, elements, anchors, css-rules or "
+                            "selectors\n";
+      return false;
+    }
+    BudgetLimits[Name] = N;
+  }
+  return true;
+}
+
+/// Report the limits of --budget that \p Metrics exceeds. Returns true if it
+/// is within all of them.
+static bool checkBudget(StringRef Page, const PageMetrics &Metrics) {
+  bool WithinBudget = true;
+  for (const auto &Limit : BudgetLimits) {
+    uint64_t Value = Metrics.getBudgetedMetric(Limit.getKey());
+    if (Value <= Limit.getValue())
+      continue;
+    WithinBudget = false;
+    (BudgetError ? WithColor::error() : WithColor::warning())
+        << Page << ": " << Value << " " << Limit.getKey()
+        << " exceed the budget of " << Limit.getValue() << '\n';
+  }
+  return WithinBudget;
+}
+
+/// Print the --page-stats report of \p Page, which is made of \p HTML and
+/// \p CSS with the functions and metadata at \p Sections.
+static void printPageStats(StringRef Page, StringRef HTML, StringRef CSS,
+                           const PageMetrics &Metrics,
+                           ArrayRef<HTMLPageSection> Sections) {
+  // Pages may be rendered concurrently; print each report in one piece.
+  std::string Report;
+  raw_string_ostream OS(Report);
+  auto PrintRow = [&](StringRef Name, const PageMetrics &M) {
+    OS << format("%12llu %12llu %10llu %10llu %10llu %10llu %10llu %10llu  ",
+                 (unsigned long long)M.HTMLBytes,
+                 (unsigned long long)M.CSSBytes,
+                 (unsigned long long)M.Elements,
+                 (unsigned long long)M.Anchors,
+                 (unsigned long long)M.CSSRules,
+                 (unsigned long long)M.Selectors,
+                 (unsigned long long)M.HasSelectors,
+                 (unsigned long long)M.SiblingSelectors)
+       << Name << '\n';
+  };
+  OS << "page stats for " << Page << ":\n";
+  for (const char *Column : {"html-bytes", "css-bytes"})
+    OS << right_justify(Column, 12) << ' ';
+  for (const char *Column : {"elements", "anchors", "css-rules", "selectors",
+                             ":has()", "~"})
+    OS << right_justify(Column, 10) << ' ';
+  OS << " function\n";
+  for (const HTMLPageSection &Section : Sections) {
+    if (Section.Function.empty())
+      continue;
+    PageMetrics M;
+    M.addHTML(HTML.slice(Section.PageBegin, Section.PageEnd));
+    M.addCSS(CSS.slice(Section.StylesBegin, Section.StylesEnd));
+    PrintRow(Section.Function, M);
+  }
+  PrintRow("(page)", Metrics);
+  OS << "  of which " << Metrics.MetadataBytes
+     << " bytes of HTML are metadata\n";
+  errs() << OS.str();
+}
+
+/// Report \p E, an error reading \p InputFilename, and return the exit code
+/// of the input. Inputs of a site are rendered concurrently and watch
+/// sessions outlive bad inputs, so reading an input must not exit.
+static int reportInputError(StringRef InputFilename, Error E) {
+  WithColor::error() << InputFilename << ": " << toString(std::move(E))
+                     << '\n';
+  return 1;
+}
+
+/// Render every module of \p InputFilename to its page. \p Symbols, if set,
+/// links the pages to those of the other inputs; \p StyleSheetURL, if not
+/// empty, is the shared stylesheet of a site. The files written next to the
+/// pages are appended to \p Sidecars, if set.
+static int renderInput(LLVMContext &Context, const std::string &InputFilename,
+                       const CrossModuleSymbolTable *Symbols,
+                       StringRef StyleSheetURL = "",
+                       HTMLWriterStats *Stats = nullptr,
+                       std::vector<std::string> *Sidecars = nullptr) {
+  TimeTraceScope TT("RenderInput", InputFilename);
+  std::unique_ptr<MemoryBuffer> MB;
+  {
+    TimeRegion T(getPhaseTimer(&PhaseReport::Read));
+    TimeTraceScope TT("ReadInput");
     ErrorOr<std::unique_ptr<MemoryBuffer>> BufferOrErr =
         MemoryBuffer::getFileOrSTDIN(InputFilename);
     if (std::error_code EC = BufferOrErr.getError()) {
       WithColor::error() << InputFilename << ": " << EC.message() << '\n';
       return 1;
     }
-    std::unique_ptr<MemoryBuffer> MB = std::move(BufferOrErr.get());
+    MB = std::move(BufferOrErr.get());
+  }
+  if (Phases)
+    Phases->InputBytes += MB->getBufferSize();
+  std::vector<HTMLMemorySample> MemorySamples;
+  // Pages over their --budget are still written, but fail the input.
+  bool OverBudget = false;
+  if (MemoryReport)
+    MemorySamples.push_back(HTMLMemorySample::take("read"));
 
-    BitcodeFileContents IF = ExitOnErr(llvm::getBitcodeFileContents(*MB));
+  BitcodeFileContents IF;
+  {
+    TimeRegion T(getPhaseTimer(&PhaseReport::Parse));
+    TimeTraceScope TT("ParseBitcode");
+    Expected<BitcodeFileContents> IFOrErr = llvm::getBitcodeFileContents(*MB);
+    if (!IFOrErr)
+      return reportInputError(InputFilename, IFOrErr.takeError());
+    IF = std::move(*IFOrErr);
+  }
 
-    const size_t N = IF.Mods.size();
+  const size_t N = IF.Mods.size();
 
-    if (OutputFilename == "-" && N > 1)
-      errs() << "only single module bitcode files can be written to stdout\n";
+  if (OutputFilename == "-" && N > 1)
+    errs() << "only single module bitcode files can be written to stdout\n";
 
-    for (size_t I = 0; I < N; ++I) {
-      BitcodeModule MB = IF.Mods[I];
+  for (size_t I = 0; I < N; ++I) {
+    BitcodeModule MB = IF.Mods[I];
 
-      std::unique_ptr<Module> M;
+    std::unique_ptr<Module> M;
 
-      if (!PrintThinLTOIndexOnly) {
-        M = ExitOnErr(
-            MB.getLazyModule(Context, MaterializeMetadata, SetImporting));
-        if (MaterializeMetadata)
-          ExitOnErr(M->materializeMetadata());
-        else
-          ExitOnErr(M->materializeAll());
+    if (!PrintThinLTOIndexOnly) {
+      LLVM_HTML_PROBE2(module_load_start, InputFilename.data(),
+                       InputFilename.size());
+      {
+        TimeRegion T(getPhaseTimer(&PhaseReport::Parse));
+        TimeTraceScope TT("ParseBitcode");
+        Expected<std::unique_ptr<Module>> MOrErr =
+            MB.getLazyModule(Context, MaterializeMetadata, SetImporting);
+        if (!MOrErr)
+          return reportInputError(InputFilename, MOrErr.takeError());
+        M = std::move(*MOrErr);
+      }
+      TimeRegion T(getPhaseTimer(&PhaseReport::Materialize));
+      TimeTraceScope TT("Materialize");
+      if (MaterializeMetadata) {
+        if (Error E = M->materializeMetadata())
+          return reportInputError(InputFilename, std::move(E));
+      } else if (!Outline || OutlineBodies) {
+        if (Error E = M->materializeAll())
+          return reportInputError(InputFilename, std::move(E));
       }
+      // Counting the instructions walks the whole module.
+      if (LLVM_HTML_PROBE_ACTIVE(module_load_end))
+        LLVM_HTML_PROBE3(module_load_end, InputFilename.data(),
+                         InputFilename.size(), M->getInstructionCount());
+    }
+    // The IR does not change from here on, so it is only measured once.
+    uint64_t IRBytes = 0;
+    if (MemoryReport) {
+      if (M)
+        IRBytes = HTMLMemorySample::getApproximateIRSize(*M);
+      MemorySamples.push_back(HTMLMemorySample::take("materialize", IRBytes));
+    }
 
-      BitcodeLTOInfo LTOInfo = ExitOnErr(MB.getLTOInfo());
-      std::unique_ptr<ModuleSummaryIndex> Index;
-      if (LTOInfo.HasSummary)
-        Index = ExitOnErr(MB.getSummary());
+    Expected<BitcodeLTOInfo> LTOInfo = MB.getLTOInfo();
+    if (!LTOInfo)
+      return reportInputError(InputFilename, LTOInfo.takeError());
+    std::unique_ptr<ModuleSummaryIndex> Index;
+    if (LTOInfo->HasSummary) {
+      Expected<std::unique_ptr<ModuleSummaryIndex>> IndexOrErr =
+          MB.getSummary();
+      if (!IndexOrErr)
+        return reportInputError(InputFilename, IndexOrErr.takeError());
+      Index = std::move(*IndexOrErr);
+    }
+
+    // Just use stdout.  We won't actually print anything on it.
+    std::string FinalFilename =
+        DontPrint ? "-" : getOutputFilename(InputFilename, I, N);
+
+    std::error_code EC;
+    std::unique_ptr<ToolOutputFile> Out(
+        new ToolOutputFile(FinalFilename, EC, sys::fs::OF_TextWithCRLF));
+    if (EC) {
+      errs() << EC.message() << '\n';
+      return 1;
+    }
 
-      std::string FinalFilename(OutputFilename);
-      // Just use stdout.  We won't actually print anything on it.
-      if (DontPrint)
-        FinalFilename = "-";
+    std::unique_ptr<AssemblyAnnotationWriter> Annotator;
+    if (ShowAnnotations)
+      Annotator.reset(new CommentWriter());
 
-      if (FinalFilename.empty()) { // Unspecified output, infer it.
-        if (InputFilename == "-") {
-          FinalFilename = "-";
+    std::string OutString;
+    std::string CSSOutString;
+    raw_string_ostream OutOS(OutString);
+    raw_string_ostream CSSOutOS(CSSOutString);
+    if (!DontPrint) {
+      if (M) {
+        HTMLWriterOptions Options;
+        Options.MaxInitializerBytes = MaxInitializerBytes;
+        Options.MaxSwitchCases = MaxSwitchCases;
+        Options.MaxPhiIncoming = MaxPhiIncoming;
+        Options.MaxBlockInstructions = MaxBlockInstructions;
+        Options.MaxPredecessors = MaxPredecessors;
+        Options.Outline = Outline;
+        Options.OutlineSummary = Index.get();
+        Options.PrecomputeSlotTables = PrecomputeSlotTables;
+        Options.ParallelMetadata = ParallelMetadata;
+        Options.ShardMetadata = ShardMetadata;
+        Options.FunctionStatsPage = FunctionStatsPage;
+        Options.StyleSheetURL = std::string(StyleSheetURL);
+        Options.CacheDir = CacheDir;
+        Options.Stats = Stats;
+        Options.Timers = Phases ? &Phases->Writer : nullptr;
+        std::vector<HTMLFunctionTime> FunctionTimes;
+        if (SlowestFunctions)
+          Options.FunctionTimes = &FunctionTimes;
+        if (MemoryReport)
+          Options.MemorySamples = &MemorySamples;
+        Options.IRBytes = IRBytes;
+        std::vector<HTMLPageSection> Sections;
+        if (PageStats || !BudgetLimits.empty())
+          Options.Sections = &Sections;
+        Options.Sidecars = Sidecars;
+        if (FinalFilename != "-")
+          Options.OutputPath = FinalFilename;
+        if (Symbols && !Options.OutputPath.empty())
+          Options.Symbols = Symbols;
+        HTMLWriter HTMLW(M.get(), Options);
+        {
+          TimeTraceScope TT("PrintModule", M->getModuleIdentifier());
+          HTMLW.print(OutOS, CSSOutOS, "" /* unused filename */,
+                      Annotator.get(), PreserveAssemblyUseListOrder);
+        }
+        if (SlowestFunctions)
+          recordFunctionTimes(InputFilename, FunctionTimes);
+        if (Options.Sections) {
+          StringRef Page = FinalFilename == "-" ? StringRef(InputFilename)
+                                                : StringRef(FinalFilename);
+          PageMetrics Metrics;
+          Metrics.addHTML(OutOS.str());
+          Metrics.addCSS(CSSOutOS.str());
+          for (const HTMLPageSection &Section : Sections)
+            if (Section.Function.empty())
+              Metrics.MetadataBytes += Section.PageEnd - Section.PageBegin;
+          if (PageStats)
+            printPageStats(Page, OutOS.str(), CSSOutOS.str(), Metrics,
+                           Sections);
+          if (!checkBudget(Page, Metrics) && BudgetError)
+            OverBudget = true;
+        }
+        if (Phases) {
+          for (const Function &F : *M)
+            Phases->Functions += !F.isDeclaration();
+          Phases->Instructions += M->getInstructionCount();
+          Phases->Anchors += StringRef(OutOS.str()).count("<a ");
+          Phases->CSSRules += StringRef(CSSOutOS.str()).count('}');
+        }
+        TimeRegion T(getPhaseTimer(&PhaseReport::InlineCSS));
+        TimeTraceScope TT("InlineCSS");
+        inlineCSS(Out->os(), OutOS.str(), CSSOutOS.str());
+        if (MemoryReport) {
+          HTMLMemorySample S = HTMLMemorySample::take("inline-css", IRBytes);
+          S.Output = OutString.capacity() + CSSOutString.capacity();
+          MemorySamples.push_back(std::move(S));
+        }
+      }
+      if (Index) {
+        HTMLSummaryWriter SummaryW(Index.get());
+        if (!M) {
+          // The summary page is streamed straight to the output.
+          SummaryW.print(Out->os());
+        } else if (FinalFilename != "-") {
+          // The module page is the output; the summary gets its own page.
+          std::string SummaryFilename = FinalFilename + ".summary.html";
+          ToolOutputFile SummaryOut(SummaryFilename, EC,
+                                    sys::fs::OF_TextWithCRLF);
+          if (EC) {
+            errs() << EC.message() << '\n';
+            return 1;
+          }
+          SummaryW.print(SummaryOut.os());
+          SummaryOut.keep();
+          if (Sidecars)
+            Sidecars->push_back(SummaryFilename);
         } else {
-          StringRef IFN = InputFilename;
-          FinalFilename = (IFN.endswith(".bc") ? IFN.drop_back(3) : IFN).str();
-          if (N > 1)
-            FinalFilename += std::string(".") + std::to_string(I);
-          FinalFilename += ".html";
+          WithColor::warning()
+              << "the summary index is only printed alongside a module "
+                 "when writing to a file\n";
         }
+      }
+    }
+
+    Out->os().flush();
+    LLVM_HTML_PROBE3(output_flush, FinalFilename.data(), FinalFilename.size(),
+                     Out->os().tell());
+    if (Phases)
+      Phases->OutputBytes += Out->os().tell();
+
+    // Declare success.
+    Out->keep();
+  }
+  if (MemoryReport)
+    printMemoryReport(InputFilename, MemorySamples);
+  return OverBudget ? 1 : 0;
+}
+
+static const char *const SiteIndex = "index.html";
+static const char *const SiteStyleSheet = "llvm-html.css";
+static const char *const SiteScript = "llvm-html.js";
+static const char *const SiteManifest = "manifest.txt";
+static const char *const SiteManifestHeader = "llvm-html-site 2";
+
+/// Filters the symbol list of the site index as the user types.
+static const char *const SiteScriptText = R"(
+document.addEventListener("DOMContentLoaded", function () {
+  var filter = document.getElementById("symbol-filter");
+  if (!filter)
+    return;
+  var items = document.querySelectorAll("#symbols li");
+  filter.addEventListener("input", function () {
+    var text = filter.value.toLowerCase();
+    for (var i = 0; i < items.length; ++i)
+      items[i].style.display =
+          items[i].textContent.toLowerCase().indexOf(text) < 0 ? "none" : "";
+  });
+});
+)";
+
+static bool writeSiteFile(StringRef Name,
+                          function_ref<void(raw_ostream &)> Write) {
+  SmallString<256> Path(SiteDir);
+  sys::path::append(Path, Name);
+  std::error_code EC;
+  ToolOutputFile File(Path, EC, sys::fs::OF_TextWithCRLF);
+  if (EC) {
+    WithColor::error() << Path << ": " << EC.message() << '\n';
+    return false;
+  }
+  Write(File.os());
+  File.keep();
+  return true;
+}
+
+/// Write the site index: the modules and the symbols they export.
+static void printSiteIndex(raw_ostream &OS, ArrayRef<InputInfo> Infos) {
+  OS << "<!DOCTYPE html>\n";
+  OS << "<html>\n";
+  OS << "<head>\n";
+  OS << "<link rel=\"stylesheet\" href=\"" << SiteStyleSheet << "\">\n";
+  OS << "<script src=\"" << SiteScript << "\" defer></script>\n";
+  OS << "<title>Index</title>\n";
+  OS << "</head>\n";
+  OS << "<body>\n";
+
+  OS << "<h1>Modules</h1>\n";
+  OS << "<ul>\n";
+  for (const InputInfo &In : Infos) {
+    for (size_t I = 0, E = In.Pages.size(); I != E; ++I) {
+      OS << "<li><a href=\"";
+      printHTMLEscaped(OS, sys::path::filename(In.Pages[I]));
+      OS << "\">";
+      printHTMLEscaped(OS, In.Filename);
+      if (E > 1)
+        OS << " (module " << I << ")";
+      OS << "</a></li>\n";
+    }
+  }
+  OS << "</ul>\n";
+
+  struct IndexEntry {
+    StringRef Name;
+    StringRef Page;
+    GlobalValue::GUID GUID;
+  };
+  std::vector<IndexEntry> Entries;
+  for (const InputInfo &In : Infos)
+    for (const InputInfo::Symbol &Sym : In.Exported)
+      Entries.push_back(
+          {Sym.Name, sys::path::filename(In.Pages[Sym.ModuleIdx]), Sym.GUID});
+  llvm::stable_sort(Entries, [](const IndexEntry &A, const IndexEntry &B) {
+    return A.Name < B.Name;
+  });
+
+  OS << "<h1>Exported symbols</h1>\n";
+  OS << "<input id=\"symbol-filter\" placeholder=\"Filter\">\n";
+  OS << "<ul id=\"symbols\">\n";
+  for (const IndexEntry &Entry : Entries) {
+    OS << "<li><a href=\"";
+    printHTMLEscaped(OS, Entry.Page);
+    OS << "#gv" << Entry.GUID << "\">";
+    printHTMLEscaped(OS, Entry.Name);
+    OS << "</a> <small>";
+    printHTMLEscaped(OS, Entry.Page);
+    OS << "</small></li>\n";
+  }
+  OS << "</ul>\n";
+  OS << "</body>\n";
+  OS << "</html>\n";
+}
+
+namespace {
+/// What the site manifest records of an input.
+struct SiteManifestEntry {
+  uint64_t InputHash = 0;
+  uint64_t SiteHash = 0;
+  /// The files written next to the pages of the input, as the writer
+  /// reported them: metadata pages, summaries, initializer and fold sidecars.
+  std::vector<std::string> Sidecars;
+};
+} // end anon namespace
+
+/// Read the input hashes recorded when the site was last written.
+static StringMap<SiteManifestEntry> readSiteManifest() {
+  StringMap<SiteManifestEntry> Entries;
+  SmallString<256> Path(SiteDir);
+  sys::path::append(Path, SiteManifest);
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufferOrErr =
+      MemoryBuffer::getFile(Path);
+  if (!BufferOrErr)
+    return Entries;
+
+  SmallVector<StringRef, 0> Lines;
+  (*BufferOrErr)->getBuffer().split(Lines, '\n', -1, /*KeepEmpty=*/false);
+  if (Lines.empty() || Lines.front().rtrim() != SiteManifestHeader)
+    return Entries;
+  SiteManifestEntry *Last = nullptr;
+  for (StringRef Line : drop_begin(Lines)) {
+    // A sidecar of the input above it: + <sidecar path>
+    if (Line.consume_front("+ ")) {
+      if (Last)
+        Last->Sidecars.push_back(std::string(Line.rtrim()));
+      continue;
+    }
+    // <input hash> <site hash> <input path>
+    Last = nullptr;
+    auto [InputHash, Rest] = Line.rtrim().split(' ');
+    auto [SiteHash, Filename] = Rest.split(' ');
+    uint64_t IH, SH;
+    if (InputHash.getAsInteger(16, IH) || SiteHash.getAsInteger(16, SH) ||
+        Filename.empty())
+      continue;
+    Last = &Entries[Filename];
+    *Last = {IH, SH, {}};
+  }
+  return Entries;
+}
+
+/// Folding the input path into the page name can give different inputs the
+/// same page, as with "a/b_c.bc" and "a_b/c.bc", or give an input the name
+/// of a file of the site itself, as with "index.bc". Add a hash of the input
+/// path to the page names of those inputs and name their pages again.
+static void separateSitePages(MutableArrayRef<InputInfo> Infos) {
+  StringSet<> Reserved;
+  for (const char *Name :
+       {SiteIndex, SiteStyleSheet, SiteScript, SiteManifest})
+    Reserved.insert(Name);
+  StringMap<unsigned> Uses;
+  for (const InputInfo &In : Infos)
+    for (const std::string &Page : In.Pages)
+      ++Uses[sys::path::filename(Page)];
+
+  for (InputInfo &In : Infos) {
+    bool Collides = llvm::any_of(In.Pages, [&](const std::string &Page) {
+      StringRef Name = sys::path::filename(Page);
+      return Uses[Name] > 1 || Reserved.contains(Name);
+    });
+    if (!Collides)
+      continue;
+    SitePageSuffixes[In.Filename] =
+        "-" + utohexstr(uint32_t(xxHash64(In.Filename)), /*LowerCase=*/true);
+    for (size_t I = 0, N = In.Pages.size(); I != N; ++I) {
+      SmallString<256> Page(getOutputFilename(In.Filename, I, N));
+      sys::fs::make_absolute(Page);
+      In.Pages[I] = std::string(Page);
+    }
+  }
+}
+
+/// Render all inputs as a site in SiteDir. Only inputs whose contents, or the
+/// options and symbol table they were rendered with, changed since the last
+/// run are rendered again; those are rendered concurrently.
+static int renderSite(ArrayRef<std::string> Inputs, StringRef OptionsKey,
+                      char *Prefix) {
+  if (std::error_code EC = sys::fs::create_directories(SiteDir)) {
+    WithColor::error() << SiteDir << ": " << EC.message() << '\n';
+    return 1;
+  }
+
+  // An input named twice would be rendered twice into the same pages.
+  std::vector<std::string> UniqueInputs;
+  StringSet<> Seen;
+  for (const std::string &Input : Inputs)
+    if (Seen.insert(Input).second)
+      UniqueInputs.push_back(Input);
+
+  SitePageSuffixes.clear();
+  std::vector<InputInfo> Infos =
+      scanInputs(UniqueInputs, /*CollectExported=*/true);
+  separateSitePages(Infos);
+  CrossModuleSymbolTable Symbols;
+  buildSymbolTable(Infos, Symbols);
+
+  // A page depends on its input, on the options and, through its links, on
+  // where every global is defined.
+  std::string SiteKey(OptionsKey);
+  for (const InputInfo &In : Infos) {
+    SiteKey += utohexstr(In.DefinitionsHash);
+    for (const std::string &Page : In.Pages)
+      SiteKey += Page;
+  }
+  uint64_t SiteHash = xxHash64(SiteKey);
+
+  StringMap<SiteManifestEntry> Previous = readSiteManifest();
+  std::vector<const InputInfo *> Stale;
+  auto Exists = [](const std::string &Path) { return sys::fs::exists(Path); };
+  for (const InputInfo &In : Infos) {
+    auto It = Previous.find(In.Filename);
+    bool UpToDate = In.Hash && !In.Pages.empty() && It != Previous.end() &&
+                    It->second.InputHash == In.Hash &&
+                    It->second.SiteHash == SiteHash &&
+                    llvm::all_of(In.Pages, Exists) &&
+                    llvm::all_of(It->second.Sidecars, Exists);
+    if (!UpToDate)
+      Stale.push_back(&In);
+  }
+
+  // The site files and the manifest are still written when some inputs
+  // fail, so that the pages that did render work; the failed inputs are left
+  // out of the manifest to be tried again.
+  std::atomic<int> Result(0);
+  std::vector<char> Failed(Infos.size());
+  // The sidecars of the inputs that are up to date are those written when
+  // they were rendered.
+  std::vector<std::vector<std::string>> Sidecars(Infos.size());
+  for (size_t I = 0, E = Infos.size(); I != E; ++I) {
+    auto It = Previous.find(Infos[I].Filename);
+    if (It != Previous.end())
+      Sidecars[I] = It->second.Sidecars;
+  }
+  auto Render = [&](const InputInfo *In) {
+    LLVMContext Context;
+    Context.setDiagnosticHandler(
+        std::make_unique<LLVMHtmlDiagnosticHandler>(Prefix));
+    size_t I = In - Infos.data();
+    Sidecars[I].clear();
+    if (int Ret = renderInput(Context, In->Filename, &Symbols, SiteStyleSheet,
+                              /*Stats=*/nullptr, &Sidecars[I])) {
+      Failed[I] = true;
+      Result = Ret;
+    }
+  };
+  // Timers are not thread safe and the trace only follows the main thread,
+  // so timed sites are rendered one input at a time.
+  if (Phases || timeTraceProfilerEnabled())
+    for_each(Stale, Render);
+  else
+    parallelForEach(Stale, Render);
+
+  // Remove the sidecars of the last run that no page uses any more, such as
+  // fold pages of constructs that are now under their budget. Those of inputs
+  // that failed are left, as their pages are.
+  StringSet<> Written;
+  for (size_t I = 0, E = Infos.size(); I != E; ++I) {
+    Written.insert(Infos[I].Pages.begin(), Infos[I].Pages.end());
+    Written.insert(Sidecars[I].begin(), Sidecars[I].end());
+  }
+  for (const InputInfo *In : Stale) {
+    auto It = Previous.find(In->Filename);
+    if (Failed[In - Infos.data()] || It == Previous.end())
+      continue;
+    for (const std::string &Sidecar : It->second.Sidecars)
+      if (!Written.contains(Sidecar))
+        sys::fs::remove(Sidecar);
+  }
+
+  bool SiteWritten =
+      writeSiteFile(SiteStyleSheet,
+                    [](raw_ostream &OS) { HTMLWriter::printSharedStyles(OS); }) &&
+      writeSiteFile(SiteScript,
+                    [](raw_ostream &OS) { OS << SiteScriptText; }) &&
+      writeSiteFile(SiteIndex,
+                    [&](raw_ostream &OS) { printSiteIndex(OS, Infos); }) &&
+      writeSiteFile(SiteManifest, [&](raw_ostream &OS) {
+        OS << SiteManifestHeader << '\n';
+        for (size_t I = 0, E = Infos.size(); I != E; ++I) {
+          const InputInfo &In = Infos[I];
+          if (!In.Hash || Failed[I])
+            continue;
+          OS << utohexstr(In.Hash) << ' ' << utohexstr(SiteHash) << ' '
+             << In.Filename << '\n';
+          for (const std::string &Sidecar : Sidecars[I])
+            OS << "+ " << Sidecar << '\n';
+        }
+      });
+  if (!SiteWritten)
+    return 1;
+
+  size_t NumFailed = llvm::count(Failed, true);
+  outs() << "rendered " << Stale.size() - NumFailed << " of " << Infos.size()
+         << " inputs";
+  if (NumFailed)
+    outs() << ", " << NumFailed << " failed";
+  outs() << '\n';
+  return Result;
+}
+
+/// Set when --watch is interrupted, so that the session ends after the
+/// rendering in progress.
+static std::atomic<bool> WatchInterrupted(false);
+
+/// The render cache made for a --watch session without --cache-dir, removed
+/// when the session ends.
+static std::string SessionCacheDir;
+
+/// The parsed --cache-policy.
+static CachePruningPolicy RenderCachePolicy;
+
+/// Expire and bound the render cache after rendering, if there is one. Only
+/// the page packs are pruned, and no more often than the policy's interval.
+static void pruneRenderCache() {
+  if (!CacheDir.empty())
+    pruneCache(CacheDir, RenderCachePolicy);
+}
+
+namespace {
+/// Waits for input files to change. On Linux, inotify on the directories
+/// holding the inputs wakes it up, which also catches files replaced by a
+/// rename; elsewhere it polls. Either way, an input counts as changed when
+/// its modification time or size did.
+class InputWatcher {
+  std::vector<std::string> Inputs;
+  std::vector<std::pair<sys::TimePoint<>, uint64_t>> Stamps;
+#ifdef __linux__
+  int NotifyFD = -1;
+#endif
+
+  std::pair<sys::TimePoint<>, uint64_t> getStamp(StringRef Input) {
+    sys::fs::file_status Status;
+    if (sys::fs::status(Input, Status))
+      return {};
+    return {Status.getLastModificationTime(), Status.getSize()};
+  }
+
+  void waitForEvents();
+
+public:
+  InputWatcher(ArrayRef<std::string> Inputs);
+  ~InputWatcher();
+
+  /// Block until some inputs changed, and return their indices. Returns none
+  /// once the session is interrupted.
+  std::vector<size_t> wait();
+};
+} // end anon namespace
+
+InputWatcher::InputWatcher(ArrayRef<std::string> Inputs)
+    : Inputs(Inputs.begin(), Inputs.end()) {
+  for (const std::string &Input : Inputs)
+    Stamps.push_back(getStamp(Input));
+#ifdef __linux__
+  NotifyFD = inotify_init1(IN_CLOEXEC);
+  if (NotifyFD < 0)
+    return;
+  for (const std::string &Input : Inputs) {
+    StringRef Dir = sys::path::parent_path(Input);
+    std::string DirName = Dir.empty() ? "." : std::string(Dir);
+    // Adding a directory twice returns the existing watch. Each write is an
+    // event too, so that a slow writer keeps postponing the rendering.
+    inotify_add_watch(NotifyFD, DirName.c_str(),
+                      IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY);
+  }
+#endif
+}
+
+InputWatcher::~InputWatcher() {
+#ifdef __linux__
+  if (NotifyFD >= 0)
+    ::close(NotifyFD);
+#endif
+}
+
+void InputWatcher::waitForEvents() {
+#ifdef __linux__
+  if (NotifyFD >= 0) {
+    // Block for the first event, then let the build finish writing: drain
+    // events until none arrived for a short while.
+    alignas(inotify_event) char Buffer[4096];
+    pollfd PFD = {NotifyFD, POLLIN, 0};
+    int Timeout = -1;
+    while (!WatchInterrupted &&
+           (::poll(&PFD, 1, Timeout) > 0 || (Timeout < 0 && errno == EINTR))) {
+      if (PFD.revents & POLLIN)
+        (void)::read(NotifyFD, Buffer, sizeof(Buffer));
+      Timeout = 100;
+    }
+    return;
+  }
+#endif
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+}
+
+std::vector<size_t> InputWatcher::wait() {
+  while (!WatchInterrupted) {
+    waitForEvents();
+    std::vector<size_t> Changed;
+    for (size_t I = 0, E = Inputs.size(); I != E; ++I) {
+      auto Stamp = getStamp(Inputs[I]);
+      // An input that is missing is still being replaced.
+      if (Stamp == decltype(Stamp)() || Stamp == Stamps[I])
+        continue;
+      Stamps[I] = Stamp;
+      Changed.push_back(I);
+    }
+    if (!Changed.empty())
+      return Changed;
+  }
+  return {};
+}
+
+/// Render the inputs again whenever they change, until interrupted. Unchanged
+/// functions are copied from the render cache, and a site only renders the
+/// changed inputs again. Inputs that fail to load are reported and rendered
+/// again on their next change.
+static int watchInputs(ArrayRef<std::string> Inputs, StringRef OptionsKey,
+                       char *Prefix) {
+  // The first interrupt ends the session cleanly; a second one kills it.
+  sys::SetInterruptFunction([] { WatchInterrupted = true; });
+  InputWatcher Watcher(Inputs);
+
+  // With --link-modules, every page links to where the globals are defined,
+  // so all pages are rendered again when that changes.
+  CrossModuleSymbolTable Symbols;
+  std::vector<uint64_t> DefinitionsHashes;
+  auto ScanDefinitions = [&] {
+    std::vector<InputInfo> Infos =
+        scanInputs(Inputs, /*CollectExported=*/false);
+    std::vector<uint64_t> Hashes;
+    for (const InputInfo &In : Infos)
+      Hashes.push_back(In.DefinitionsHash);
+    if (Hashes == DefinitionsHashes)
+      return false;
+    DefinitionsHashes = std::move(Hashes);
+    Symbols = CrossModuleSymbolTable();
+    buildSymbolTable(Infos, Symbols);
+    return true;
+  };
+  if (SiteDir.empty() && LinkModules)
+    ScanDefinitions();
+
+  outs() << "watching " << Inputs.size() << " inputs\n";
+  outs().flush();
+  while (true) {
+    std::vector<size_t> Changed = Watcher.wait();
+    if (Changed.empty())
+      break;
+    auto Start = std::chrono::steady_clock::now();
+
+    if (!SiteDir.empty()) {
+      renderSite(Inputs, OptionsKey, Prefix);
+      pruneRenderCache();
+      outs().flush();
+      continue;
+    }
+
+    std::vector<size_t> Stale = Changed;
+    if (LinkModules && ScanDefinitions()) {
+      Stale.resize(Inputs.size());
+      std::iota(Stale.begin(), Stale.end(), 0);
+    }
+    HTMLWriterStats Stats;
+    size_t NumFailed = 0;
+    for (size_t I : Stale) {
+      LLVMContext Context;
+      Context.setDiagnosticHandler(
+          std::make_unique<LLVMHtmlDiagnosticHandler>(Prefix));
+      if (renderInput(Context, Inputs[I], LinkModules ? &Symbols : nullptr, "",
+                      &Stats))
+        ++NumFailed;
+    }
+    auto Elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - Start);
+    outs() << "rendered " << Stale.size() - NumFailed << " of "
+           << Inputs.size() << " inputs in " << Elapsed.count() << " ms ("
+           << Stats.FunctionsRendered << " functions rendered, "
+           << Stats.FunctionsReused << " reused)";
+    if (NumFailed)
+      outs() << ", " << NumFailed << " failed";
+    outs() << '\n';
+    outs().flush();
+    pruneRenderCache();
+  }
+
+  if (!SessionCacheDir.empty())
+    if (std::error_code EC = sys::fs::remove_directories(SessionCacheDir))
+      WithColor::warning() << SessionCacheDir << ": " << EC.message() << '\n';
+  return 0;
+}
+
+namespace {
+/// Rendered pages, dropped least recently used first once they take up more
+/// than a given number of bytes.
+class PageCache {
+  using Entry = std::pair<GlobalValue::GUID, std::string>;
+  /// Most recently used first.
+  std::list<Entry> Pages;
+  DenseMap<GlobalValue::GUID, std::list<Entry>::iterator> Index;
+  size_t Bytes = 0;
+  size_t MaxBytes;
+
+public:
+  PageCache(size_t MaxBytes) : MaxBytes(MaxBytes) {}
+
+  size_t size() const { return Pages.size(); }
+
+  const std::string *lookup(GlobalValue::GUID GUID) {
+    auto I = Index.find(GUID);
+    if (I == Index.end())
+      return nullptr;
+    Pages.splice(Pages.begin(), Pages, I->second);
+    return &I->second->second;
+  }
+
+  /// Add \p Page, evicting old pages as needed. The newest page is kept even
+  /// if it alone is over the limit.
+  const std::string &insert(GlobalValue::GUID GUID, std::string Page) {
+    Bytes += Page.size();
+    Pages.emplace_front(GUID, std::move(Page));
+    Index[GUID] = Pages.begin();
+    while (Bytes > MaxBytes && Pages.size() > 1) {
+      Bytes -= Pages.back().second.size();
+      Index.erase(Pages.back().first);
+      Pages.pop_back();
+    }
+    return Pages.front().second;
+  }
+};
+
+/// Serves one lazily loaded module over HTTP: an index of its functions, and
+/// a page for each function that is rendered when it is first requested.
+///
+/// The bodies of rendered functions stay loaded. Memory is bounded at the
+/// page level instead: once the module holds many more bodies than there are
+/// cached pages, it is dropped and read again lazily, so that only the bodies
+/// of the pages requested after that are loaded.
+class PageServer {
+  BitcodeModule &Bitcode;
+  char *Prefix;
+  std::unique_ptr<LLVMContext> Context;
+  std::unique_ptr<Module> M;
+  /// The bodies loaded since the module was read.
+  size_t NumLoadedBodies = 0;
+  DenseMap<GlobalValue::GUID, Function *> Functions;
+  PageCache Cache;
+  std::string IndexPage;
+  std::string StyleSheet;
+
+  void printIndexPage();
+  std::string renderFunction(GlobalValue::GUID GUID);
+  void handleConnection(int FD);
+
+public:
+  PageServer(BitcodeModule &Bitcode, char *Prefix, size_t CacheBytes);
+
+  /// Read the module-level parts of the module, dropping the module read
+  /// before, if any.
+  Error loadModule();
+
+  /// Listen on \p Address and serve requests until killed.
+  int run(StringRef Address);
+};
+} // end anon namespace
+
+PageServer::PageServer(BitcodeModule &Bitcode, char *Prefix,
+                       size_t CacheBytes)
+    : Bitcode(Bitcode), Prefix(Prefix), Cache(CacheBytes) {
+  raw_string_ostream StyleOS(StyleSheet);
+  HTMLWriter::printSharedStyles(StyleOS);
+}
+
+Error PageServer::loadModule() {
+  auto NewContext = std::make_unique<LLVMContext>();
+  NewContext->setDiagnosticHandler(
+      std::make_unique<LLVMHtmlDiagnosticHandler>(Prefix));
+  Expected<std::unique_ptr<Module>> NewM = Bitcode.getLazyModule(
+      *NewContext, /*ShouldLazyLoadMetadata=*/true, SetImporting);
+  if (!NewM)
+    return NewM.takeError();
+  if (Error E = (*NewM)->materializeMetadata())
+    return E;
+
+  // The module goes before the context that owns its types and constants.
+  Functions.clear();
+  M = std::move(*NewM);
+  Context = std::move(NewContext);
+  NumLoadedBodies = 0;
+  for (Function &F : *M)
+    if (!F.isDeclaration())
+      Functions.try_emplace(F.getGUID(), &F);
+  if (IndexPage.empty())
+    printIndexPage();
+  return Error::success();
+}
+
+void PageServer::printIndexPage() {
+  raw_string_ostream IndexOS(IndexPage);
+  IndexOS << "<!DOCTYPE html>\n";
+  IndexOS << "<html>\n";
+  IndexOS << "<head>\n";
+  IndexOS << "<link rel=\"stylesheet\" href=\"/" << SiteStyleSheet << "\">\n";
+  IndexOS << "<script src=\"/" << SiteScript << "\" defer></script>\n";
+  IndexOS << "<title>";
+  printHTMLEscaped(IndexOS, M->getModuleIdentifier());
+  IndexOS << "</title>\n";
+  IndexOS << "</head>\n";
+  IndexOS << "<body>\n";
+  IndexOS << "<h1>";
+  printHTMLEscaped(IndexOS, M->getModuleIdentifier());
+  IndexOS << "</h1>\n";
+  IndexOS << "<input id=\"symbol-filter\" placeholder=\"Filter\">\n";
+  IndexOS << "<ul id=\"symbols\">\n";
+  for (Function &F : *M) {
+    if (F.isDeclaration())
+      continue;
+    IndexOS << "<li><a href=\"/f/" << F.getGUID() << "\">";
+    printHTMLEscaped(IndexOS, F.getName());
+    IndexOS << "</a></li>\n";
+  }
+  IndexOS << "</ul>\n";
+  IndexOS << "</body>\n";
+  IndexOS << "</html>\n";
+}
+
+/// Print the page reporting that a function could not be rendered.
+static void printErrorPage(raw_ostream &OS, Error E) {
+  OS << "<!DOCTYPE html>\n<html><body><pre>";
+  printHTMLEscaped(OS, toString(std::move(E)));
+  OS << "</pre></body></html>\n";
+}
+
+std::string PageServer::renderFunction(GlobalValue::GUID GUID) {
+  std::string Page;
+  raw_string_ostream PageOS(Page);
+  // Twice as many bodies as pages leaves room for the pages evicted since
+  // the module was read, without reading it again for every request.
+  if (NumLoadedBodies > 2 * Cache.size()) {
+    if (Error E = loadModule()) {
+      printErrorPage(PageOS, std::move(E));
+      return Page;
+    }
+  }
+
+  Function &F = *Functions.lookup(GUID);
+  if (F.isMaterializable())
+    ++NumLoadedBodies;
+  if (Error E = F.materialize()) {
+    printErrorPage(PageOS, std::move(E));
+    return Page;
+  }
+
+  HTMLWriterOptions Options;
+  Options.MaxSwitchCases = MaxSwitchCases;
+  Options.MaxPhiIncoming = MaxPhiIncoming;
+  Options.MaxBlockInstructions = MaxBlockInstructions;
+  Options.MaxPredecessors = MaxPredecessors;
+  Options.StyleSheetURL = std::string("/") + SiteStyleSheet;
+  Options.FunctionPageURLPrefix = "/f/";
+  std::string Body, CSS;
+  raw_string_ostream BodyOS(Body);
+  raw_string_ostream CSSOS(CSS);
+  HTMLWriter(M.get(), Options).printFunction(BodyOS, CSSOS, F);
+  inlineCSS(PageOS, BodyOS.str(), CSSOS.str());
+  return Page;
+}
+
+#ifdef LLVM_ON_UNIX
+/// Write all of \p Data to \p FD, giving up if the peer has gone away.
+static void writeAll(int FD, StringRef Data) {
+  while (!Data.empty()) {
+    ssize_t N = ::write(FD, Data.data(), Data.size());
+    if (N < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    Data = Data.drop_front(N);
+  }
+}
+
+static void sendResponse(int FD, StringRef Status, StringRef ContentType,
+                         StringRef Body) {
+  std::string Header;
+  raw_string_ostream HeaderOS(Header);
+  HeaderOS << "HTTP/1.1 " << Status << "\r\n"
+           << "Content-Type: " << ContentType << "; charset=utf-8\r\n"
+           << "Content-Length: " << Body.size() << "\r\n"
+           << "Connection: close\r\n\r\n";
+  writeAll(FD, HeaderOS.str());
+  writeAll(FD, Body);
+}
+
+void PageServer::handleConnection(int FD) {
+  // Only the request line matters; read up to the end of the headers.
+  std::string Request;
+  char Buffer[4096];
+  while (Request.find("\r\n\r\n") == std::string::npos &&
+         Request.size() < 64 * 1024) {
+    ssize_t N = ::read(FD, Buffer, sizeof(Buffer));
+    if (N < 0 && errno == EINTR)
+      continue;
+    if (N <= 0)
+      break;
+    Request.append(Buffer, N);
+  }
+  // The client hung up or stalled before sending a request.
+  if (Request.empty())
+    return;
+
+  SmallVector<StringRef, 3> Parts;
+  StringRef(Request).split('\n').first.rtrim().split(Parts, ' ');
+  if (Parts.size() != 3 || Parts[0] != "GET") {
+    sendResponse(FD, "405 Method Not Allowed", "text/plain",
+                 "only GET is supported\n");
+    return;
+  }
+  StringRef Path = Parts[1].split('?').first;
+  Path.consume_front("/");
+
+  if (Path.empty() || Path == "index.html")
+    return sendResponse(FD, "200 OK", "text/html", IndexPage);
+  if (Path == SiteStyleSheet)
+    return sendResponse(FD, "200 OK", "text/css", StyleSheet);
+  if (Path == SiteScript)
+    return sendResponse(FD, "200 OK", "text/javascript", SiteScriptText);
+
+  GlobalValue::GUID GUID;
+  auto I = Functions.end();
+  if (Path.consume_front("f/") && !Path.getAsInteger(10, GUID))
+    I = Functions.find(GUID);
+  if (I == Functions.end())
+    return sendResponse(FD, "404 Not Found", "text/plain", "no such page\n");
+
+  const std::string *Page = Cache.lookup(GUID);
+  if (!Page)
+    Page = &Cache.insert(GUID, renderFunction(GUID));
+  sendResponse(FD, "200 OK", "text/html", *Page);
+}
+
+int PageServer::run(StringRef Address) {
+  auto [Host, PortString] = Address.rsplit(':');
+  unsigned Port;
+  if (Host == "localhost")
+    Host = "127.0.0.1";
+  sockaddr_in Addr = {};
+  Addr.sin_family = AF_INET;
+  if (PortString.getAsInteger(10, Port) || Port > 65535 ||
+      ::inet_pton(AF_INET, std::string(Host).c_str(), &Addr.sin_addr) != 1) {
+    WithColor::error() << "--serve expects 127.0.0.1:port, got '" << Address
+                       << "'\n";
+    return 1;
+  }
+  // Pages are served to anyone who can connect, so stay on this machine.
+  if ((ntohl(Addr.sin_addr.s_addr) >> 24) != 127) {
+    WithColor::error() << "--serve only listens on loopback addresses\n";
+    return 1;
+  }
+  Addr.sin_port = htons(Port);
+
+  int Listener = ::socket(AF_INET, SOCK_STREAM, 0);
+  int One = 1;
+  if (Listener < 0 ||
+      ::setsockopt(Listener, SOL_SOCKET, SO_REUSEADDR, &One, sizeof(One)) ||
+      ::bind(Listener, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) ||
+      ::listen(Listener, SOMAXCONN)) {
+    WithColor::error() << Address << ": " << std::strerror(errno) << '\n';
+    if (Listener >= 0)
+      ::close(Listener);
+    return 1;
+  }
+
+  // Report the port actually bound, so that port 0 can be used.
+  socklen_t AddrLen = sizeof(Addr);
+  ::getsockname(Listener, reinterpret_cast<sockaddr *>(&Addr), &AddrLen);
+  outs() << "serving " << M->getModuleIdentifier() << " on http://" << Host
+         << ':' << ntohs(Addr.sin_port) << "/\n";
+  outs().flush();
+
+  // A client hanging up mid-response must not end the server.
+  ::signal(SIGPIPE, SIG_IGN);
+
+  // Connections are served once their request arrives. Browsers open
+  // connections ahead of the requests they may send on them, so one that
+  // stays silent must not hold up the others; it is closed once idle for
+  // too long. A request that stalls half way is given up on by the read
+  // timeout.
+  struct Client {
+    int FD;
+    std::chrono::steady_clock::time_point Accepted;
+  };
+  const auto IdleTimeout = std::chrono::seconds(30);
+  std::vector<Client> Clients;
+  std::vector<pollfd> FDs;
+  while (true) {
+    FDs.assign(1, {Listener, POLLIN, 0});
+    for (const Client &C : Clients)
+      FDs.push_back({C.FD, POLLIN, 0});
+    if (::poll(FDs.data(), FDs.size(), /*timeout=*/1000) < 0) {
+      if (errno == EINTR)
+        continue;
+      WithColor::error() << "poll: " << std::strerror(errno) << '\n';
+      break;
+    }
+
+    auto Now = std::chrono::steady_clock::now();
+    std::vector<Client> Waiting;
+    for (size_t I = 0, E = Clients.size(); I != E; ++I) {
+      const Client &C = Clients[I];
+      if (FDs[I + 1].revents) {
+        handleConnection(C.FD);
+        ::close(C.FD);
+      } else if (Now - C.Accepted > IdleTimeout) {
+        ::close(C.FD);
       } else {
-        if (N > 1)
-          FinalFilename += std::string(".") + std::to_string(I);
+        Waiting.push_back(C);
       }
+    }
+    Clients = std::move(Waiting);
+
+    if (!(FDs[0].revents & POLLIN))
+      continue;
+    int FD = ::accept(Listener, nullptr, nullptr);
+    if (FD < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      WithColor::error() << "accept: " << std::strerror(errno) << '\n';
+      break;
+    }
+    timeval ReadTimeout = {5, 0};
+    ::setsockopt(FD, SOL_SOCKET, SO_RCVTIMEO, &ReadTimeout,
+                 sizeof(ReadTimeout));
+    Clients.push_back({FD, Now});
+  }
+
+  for (const Client &C : Clients)
+    ::close(C.FD);
+  ::close(Listener);
+  return 1;
+}
+#else
+int PageServer::run(StringRef Address) {
+  WithColor::error() << "--serve is not supported on this platform\n";
+  return 1;
+}
+#endif
+
+/// Serve the first module of \p InputFilename on the --serve address. Only
+/// the module-level parts are read up front; function bodies are loaded as
+/// their pages are requested.
+static int serveInput(const std::string &InputFilename, char *Prefix) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufferOrErr =
+      MemoryBuffer::getFileOrSTDIN(InputFilename);
+  if (std::error_code EC = BufferOrErr.getError()) {
+    WithColor::error() << InputFilename << ": " << EC.message() << '\n';
+    return 1;
+  }
+  std::unique_ptr<MemoryBuffer> MB = std::move(BufferOrErr.get());
+
+  BitcodeFileContents IF = ExitOnErr(llvm::getBitcodeFileContents(*MB));
+  if (IF.Mods.empty()) {
+    WithColor::error() << InputFilename << ": no module to serve\n";
+    return 1;
+  }
+  if (IF.Mods.size() > 1)
+    WithColor::warning() << InputFilename
+                         << ": only the first module is served\n";
+
+  PageServer Server(IF.Mods[0], Prefix, size_t(ServeCacheSize) * 1024 * 1024);
+  ExitOnErr(Server.loadModule());
+  return Server.run(Serve);
+}
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+
+  ExitOnErr.setBanner(std::string(argv[0]) + ": error: ");
+
+  cl::HideUnrelatedOptions({&HtmlCategory, &getColorCategory()});
+  cl::ParseCommandLineOptions(argc, argv, "llvm .bc -> .html emitter\n");
+
+  LLVMContext Context;
+  Context.setDiagnosticHandler(
+      std::make_unique<LLVMHtmlDiagnosticHandler>(argv[0]));
 
-      std::error_code EC;
-      std::unique_ptr<ToolOutputFile> Out(
-          new ToolOutputFile(FinalFilename, EC, sys::fs::OF_TextWithCRLF));
-      if (EC) {
-        errs() << EC.message() << '\n';
+  std::optional<PhaseReport> PhaseData;
+  if (TimePhases || !TimePhasesJSON.empty()) {
+    PhaseData.emplace();
+    Phases = &*PhaseData;
+  }
+  if (TimeTrace || !TimeTraceFile.empty())
+    timeTraceProfilerInitialize(TimeTraceGranularity, argv[0]);
+
+  if (!parseBudget())
+    return 1;
+
+  if (InputFilenames.size() < 1) {
+    InputFilenames.push_back("-");
+  } else if (InputFilenames.size() > 1 && !OutputFilename.empty()) {
+    errs()
+        << "error: output file name cannot be set for multiple input files\n";
+    return 1;
+  }
+
+  // An outline leaves the bodies out, so there is nothing to measure.
+  if (Outline && FunctionStatsPage) {
+    errs() << "error: --function-stats-page cannot be combined with "
+              "--outline\n";
+    return 1;
+  }
+
+  if (Watch) {
+    if (llvm::is_contained(InputFilenames, "-")) {
+      errs() << "error: --watch cannot watch standard input\n";
+      return 1;
+    }
+    if (!Serve.empty()) {
+      errs() << "error: --watch cannot be combined with --serve\n";
+      return 1;
+    }
+    // Re-rendering relies on the render cache; keep one in the temporary
+    // directory for the session if none was given.
+    if (CacheDir.empty()) {
+      SmallString<128> Prefix, Dir;
+      sys::path::system_temp_directory(/*ErasedOnReboot=*/true, Prefix);
+      sys::path::append(Prefix, "llvm-html-cache");
+      if (std::error_code EC = sys::fs::createUniqueDirectory(Prefix, Dir)) {
+        WithColor::error() << "cannot create a render cache: " << EC.message()
+                           << '\n';
         return 1;
       }
+      CacheDir = SessionCacheDir = std::string(Dir);
+    }
+  }
 
-      std::unique_ptr<AssemblyAnnotationWriter> Annotator;
-      if (ShowAnnotations)
-        Annotator.reset(new CommentWriter());
-
-      std::string OutString;
-      std::string CSSOutString;
-      raw_string_ostream OutOS(OutString);
-      raw_string_ostream CSSOutOS(CSSOutString);
-      if (!DontPrint) {
-        if (M) {
-          HTMLWriter HTMLW(M.get());
-          HTMLW.print(OutOS, CSSOutOS, "" /* unused filename */,
-                      Annotator.get(), PreserveAssemblyUseListOrder);
-        }
-        if (Index)
-          Index->print(Out->os());
-      }
+  if (!CacheDir.empty()) {
+    if (std::error_code EC = sys::fs::create_directories(CacheDir)) {
+      WithColor::error() << CacheDir << ": " << EC.message() << '\n';
+      return 1;
+    }
+    Expected<CachePruningPolicy> Policy = parseCachePruningPolicy(CachePolicy);
+    if (!Policy) {
+      WithColor::error() << "--cache-policy: "
+                         << toString(Policy.takeError()) << '\n';
+      return 1;
+    }
+    RenderCachePolicy = *Policy;
+  }
 
-      inlineCSS(Out->os(), OutOS.str(), CSSOutOS.str());
+  if (!Serve.empty()) {
+    if (InputFilenames.size() != 1) {
+      errs() << "error: --serve takes a single input file\n";
+      return 1;
+    }
+    return serveInput(InputFilenames[0], argv[0]);
+  }
 
-      // Declare success.
-      Out->keep();
+  if (!SiteDir.empty()) {
+    if (!OutputFilename.empty()) {
+      errs() << "error: output file name cannot be set for a site\n";
+      return 1;
     }
+    // Everything but the inputs and the reports decides how the pages look.
+    // The budgets are part of it too: pages reused from an earlier run are
+    // not measured again, so a changed budget must render them again.
+    std::string OptionsKey;
+    for (int I = 1; I < argc; ++I) {
+      StringRef Opt = StringRef(argv[I]).ltrim('-');
+      if (argv[I][0] == '-' && Opt != "watch" && !Opt.startswith("time-") &&
+          !Opt.startswith("slowest-functions") && Opt != "memory-report" &&
+          Opt != "page-stats" && !Opt.startswith("cache-policy"))
+        OptionsKey += std::string(argv[I]) + '\n';
+    }
+    int Ret = renderSite(InputFilenames, OptionsKey, argv[0]);
+    pruneRenderCache();
+    printReports();
+    // A watch session carries on past inputs that failed to render.
+    if (!Watch)
+      return Ret;
+    return watchInputs(InputFilenames, OptionsKey, argv[0]);
+  }
+
+  CrossModuleSymbolTable Symbols;
+  if (LinkModules && !DontPrint)
+    buildSymbolTable(scanInputs(InputFilenames, /*CollectExported=*/false),
+                     Symbols);
+
+  for (std::string InputFilename : InputFilenames) {
+    if (int Ret = renderInput(Context, InputFilename,
+                              LinkModules ? &Symbols : nullptr))
+      if (!Watch)
+        return Ret;
   }
+  pruneRenderCache();
+  printReports();
 
+  if (Watch)
+    return watchInputs(InputFilenames, "", argv[0]);
   return 0;
 }